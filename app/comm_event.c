@@ -0,0 +1,95 @@
+/*
+ * comm_event.c
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: MSc Patryk Silkowski
+ */
+
+#include "comm_event.h"
+
+/* GCC */
+#include <stddef.h>
+#include <string.h>
+
+/* SDK */
+#include "app_scheduler.h"
+#include "nrf_balloc.h"
+#include "nrf_log.h"
+
+
+/*
+ * The packet data pointers of the event point to the payload of the object,
+ * so the event stays valid after the client has freed its buffer
+ */
+typedef struct {
+    mqttsn_event_t       event;
+    comm_event_handler_t handler;
+    uint8_t              payload[COMM_EVENT_PAYLOAD_MAX];
+} comm_event_t;
+
+
+NRF_BALLOC_DEF(m_event_pool, sizeof(comm_event_t), COMM_EVENT_POOL_SIZE);
+
+
+static void sched_event_handler(void * p_event_data, uint16_t event_size)
+{
+    comm_event_t * p_obj = *(comm_event_t **) p_event_data;
+
+    p_obj->handler(&p_obj->event);
+
+    nrf_balloc_free(&m_event_pool, p_obj);
+}
+
+
+int8_t comm_event_init(void)
+{
+    if (NRF_SUCCESS != nrf_balloc_init(&m_event_pool))
+        return -1;
+
+    return 0;
+}
+
+
+int8_t comm_event_sched_put(mqttsn_event_t const * p_event,
+                            comm_event_handler_t handler)
+{
+    comm_event_t * p_obj = nrf_balloc_alloc(&m_event_pool);
+
+    if (NULL == p_obj)
+    {
+        NRF_LOG_ERROR("Event: pool exhausted, event %d dropped\r\n",
+                      p_event->event_id);
+        return -1;
+    }
+
+    p_obj->event   = *p_event;
+    p_obj->handler = handler;
+
+    // the client frees the received packet right after the callback
+    if (MQTTSN_EVENT_RECEIVED == p_event->event_id)
+    {
+        mqttsn_packet_t * p_packet = &p_obj->event.event_data.published.packet;
+
+        if (p_packet->len > COMM_EVENT_PAYLOAD_MAX)
+        {
+            NRF_LOG_ERROR("Event: payload of %d B dropped\r\n", p_packet->len);
+            nrf_balloc_free(&m_event_pool, p_obj);
+            return -2;
+        }
+
+        memcpy(p_obj->payload, p_packet->p_data, p_packet->len);
+
+        p_packet->p_data = p_obj->payload;
+        p_obj->event.event_data.published.p_payload = p_obj->payload;
+    }
+
+    if (NRF_SUCCESS != app_sched_event_put(&p_obj,
+                                           sizeof(comm_event_t *),
+                                           sched_event_handler))
+    {
+        nrf_balloc_free(&m_event_pool, p_obj);
+        return -3;
+    }
+
+    return 0;
+}
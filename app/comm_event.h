@@ -0,0 +1,40 @@
+/*
+ * comm_event.h
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: MSc Patryk Silkowski
+ */
+
+#ifndef APP_COMM_EVENT_H_
+#define APP_COMM_EVENT_H_
+
+/* GCC */
+#include <stdint.h>
+
+/* SDK */
+#include "mqttsn_client.h"
+
+
+#define COMM_EVENT_POOL_SIZE        8       /**< Events queued at once, keep with SCHED_QUEUE_SIZE. */
+#define COMM_EVENT_PAYLOAD_MAX      64      /**< Max length of the received payload [B]. */
+
+
+typedef void (*comm_event_handler_t) (mqttsn_event_t * p_event);
+
+
+/**@brief Function for initializing the pool of events.
+ */
+int8_t comm_event_init(void);
+
+/**@brief Function for passing the MQTT-SN event to the scheduler.
+ *
+ * @details The event (and the payload of the received message) is copied once
+ * into the pooled object, the scheduler carries only the pointer to it. The
+ * handler is called from the scheduler context and the object is released
+ * right after, so the handler has to copy whatever it keeps.
+ */
+int8_t comm_event_sched_put(mqttsn_event_t const * p_event,
+                            comm_event_handler_t handler);
+
+
+#endif /* APP_COMM_EVENT_H_ */
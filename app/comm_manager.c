@@ -13,27 +13,844 @@
 #include <string.h>
 
 /* SDK */
+#include "app_timer.h"
 #include "nrf_log.h"
 #include "nrf_log_ctrl.h"
 #include "nrf_log_default_backends.h"
 
+/* APP */
+#include "comm_poll.h"
+#include "mash_storage.h"
+
 
 #define SEARCH_GATEWAY_TIMEOUT      30                                      /**< MQTT-SN Gateway discovery procedure timeout in [s]. */
 #define SEARCH_GATEWAY_TRIES        20                                      /**< Amount of attempts to connect to the MQTT-SN gateway */
 
-#define MQTTSN_EVENT_COUNT          16                                      /**< Amount of MQTT-SN events. */
+#define MQTTSN_EVENT_COUNT          16                                      /**< Amount of MQTT-SN events. */
+
+#define INFLIGHT_SIZE               8                                       /**< Transactions awaiting acknowledgement, power of two. */
+#define INFLIGHT_DEADLINE_MS        60000                                   /**< Age after which the lost transaction might be reclaimed [ms]. */
+#define INFLIGHT_TICKS_HALF_RANGE   0x800000                                /**< Half of the 24-bit RTC counter. */
+
+#define PUBLISH_QUEUE_SIZE          8                                       /**< Publishes queued at once (in flight included). */
+#define PUBLISH_RETRY_MS            500                                     /**< Retry of the publish refused by the client (queue full) [ms]. */
+
+#define GATEWAY_TABLE_SIZE          4                                       /**< Gateways known at once. */
+#define GATEWAY_FAILURE_PENALTY_MS  2000                                    /**< Rank penalty of each failure of the gateway [ms]. */
+#define GATEWAY_FAILURES_MAX        8                                       /**< Saturation of the failure history. */
+
+#define RTO_INITIAL_MS              1000                                    /**< Retransmission timeout before the first RTT sample [ms]. */
+#define RTO_MIN_MS                  200                                     /**< Lower bound of the retransmission timeout [ms]. */
+#define RTO_MAX_MS                  30000                                   /**< Upper bound of the retransmission timeout and the backoff [ms]. */
+
+static mqttsn_client_t      m_client;                                       /**< An MQTT-SN client instance. */
+static mqttsn_remote_t      m_gateway_addr;                                 /**< A gateway address. */
+static bool                 m_gateway_known = false;                        /**< The gateway address is valid. */
+static uint8_t              m_gateway_id;                                   /**< A gateway ID. */
+static mqttsn_connect_opt_t m_connect_opt;                                  /**< Connect options for the MQTT-SN client. */
+
+static comm_manager_event_cb m_event_cb[MQTTSN_EVENT_COUNT];
+
+static uint32_t             m_srtt;                                         /**< Smoothed RTT [ms], scaled by 8. */
+static uint32_t             m_rttvar;                                       /**< RTT variation [ms], scaled by 4. */
+
+static comm_manager_retry_stats_t m_retry_stats;
+
+
+/**@brief Gateway found with SEARCHGW (GWINFO), ranked with its RTT estimate
+ * and the failure history.
+ */
+typedef struct {
+    mqttsn_remote_t addr;
+    uint8_t         id;
+    bool            is_used;
+    uint8_t         failures;                                               /**< Halved with each CONNACK. */
+    uint16_t        rtt_samples;
+    uint32_t        srtt;                                                   /**< Scaled as m_srtt. */
+    uint32_t        rttvar;                                                 /**< Scaled as m_rttvar. */
+} gateway_t;
+
+static gateway_t            m_gateways[GATEWAY_TABLE_SIZE];
+static uint8_t              m_gateway_idx = GATEWAY_TABLE_SIZE;             /**< Gateway in use, GATEWAY_TABLE_SIZE - none. */
+
+
+/**@brief Last gateway which accepted the CONNECT, kept in the flash.
+ */
+typedef struct {
+    mqttsn_remote_t addr;
+    uint8_t         id;
+} gateway_record_t;
+
+static gateway_record_t     m_gateway_record;                               /**< Copy of the stored record. */
+
+static void listen_timer_handler(void * p_context);
+
+APP_TIMER_DEF(m_listen_timer);                                              /**< Passive discovery window. */
+static bool                 m_is_listening = false;
+static comm_manager_discovery_stats_t m_discovery_stats;
+
+
+/**@brief Transaction awaiting the acknowledgement.
+ */
+typedef struct {
+    uint16_t            msg_id;
+    comm_manager_op_t   op;                                                 /**< comm_op_none - free entry. */
+    comm_manager_ack_cb owner_cb;
+    void              * p_context;
+    uint32_t            deadline;                                           /**< app_timer ticks. */
+} inflight_t;
+
+/**@brief In-flight transactions indexed with the message ID.
+ *
+ * @details The client assigns the message IDs sequentially, so the lower bits
+ * of the ID select the entry directly and the probing is needed only if
+ * the older transaction is still there. The entry is reserved before the
+ * message is sent, at the ID which follows the last one.
+ */
+static inflight_t           m_inflight[INFLIGHT_SIZE];
+static uint16_t             m_inflight_next_id;                             /**< Expected ID of the next message. */
+
+
+/**@brief Outbound publish, the oldest one (lowest seq) is sent first.
+ */
+typedef struct {
+    uint16_t topic_id;                                                      /**< 0 - free entry. */
+    uint16_t msg_id;
+    uint16_t seq;
+    uint8_t  data_len;
+    bool     is_in_flight;
+    uint8_t  data[COMM_PUBLISH_DATA_MAX];
+} publish_entry_t;
+
+static publish_entry_t      m_publish_queue[PUBLISH_QUEUE_SIZE];
+static uint16_t             m_publish_seq;
+
+static void publish_timer_handler(void * p_context);
+
+APP_TIMER_DEF(m_publish_timer);                                             /**< Retry of the publish refused by the client. */
+
+static comm_manager_publish_stats_t m_publish_stats;
+
+/***************************************************************************************************
+ * @section In-flight transactions
+ **************************************************************************************************/
+
+
+/**@brief Drops all transactions (the session is restarted).
+ */
+static void inflight_clear(void)
+{
+    for (uint8_t i = 0; i < INFLIGHT_SIZE; i++)
+    {
+        m_inflight[i].op = comm_op_none;
+    }
+}
+
+
+static uint8_t inflight_count(void)
+{
+    uint8_t count = 0;
+
+    for (uint8_t i = 0; i < INFLIGHT_SIZE; i++)
+    {
+        if (m_inflight[i].op != comm_op_none)
+            count++;
+    }
+
+    return count;
+}
+
+
+/**@brief Feeds the poll period governor with the work awaiting the gateway.
+ */
+static void poll_update(void)
+{
+    uint8_t pending = inflight_count();
+
+    switch (mqttsn_client_state_get(&m_client))
+    {
+        case MQTTSN_CLIENT_CONNECTED:
+            // queued publishes wait for the free in-flight slot, not for the
+            // connection (the idle period is kept while the gateway is away)
+            pending += m_publish_stats.depth - m_publish_stats.in_flight;
+        break;
+
+        case MQTTSN_CLIENT_ESTABLISHING_CONNECTION:
+        case MQTTSN_CLIENT_WAITING_FOR_SLEEP:
+        case MQTTSN_CLIENT_WAITING_FOR_DISCONNECT:
+            pending++;
+        break;
+
+        default:
+        break;
+    }
+
+    comm_poll_update(pending);
+}
+
+
+static inflight_t * inflight_find(uint16_t msg_id, comm_manager_op_t op)
+{
+    for (uint8_t i = 0; i < INFLIGHT_SIZE; i++)
+    {
+        inflight_t * p_entry = &m_inflight[(msg_id + i) & (INFLIGHT_SIZE - 1)];
+
+        if (   p_entry->op == op
+            && p_entry->msg_id == msg_id)
+        {
+            return p_entry;
+        }
+    }
+
+    return NULL;
+}
+
+
+/**@brief Reserves the transaction of the message about to be sent.
+ *
+ * @details The entry is taken before the message goes on air, so the message
+ * is not sent at all if its acknowledgement could not be matched. If the
+ * table is full, the transaction which exceeded its deadline (the
+ * acknowledgement and the timeout got lost) is reclaimed. The message ID is
+ * set with inflight_commit() once the client has assigned it.
+ */
+static inflight_t * inflight_reserve(comm_manager_op_t op,
+                                     comm_manager_ack_cb owner_cb,
+                                     void * p_context)
+{
+    uint32_t     now       = app_timer_cnt_get();
+    uint16_t     msg_id    = m_inflight_next_id;
+    inflight_t * p_entry   = NULL;
+    inflight_t * p_expired = NULL;
+
+    for (uint8_t i = 0; i < INFLIGHT_SIZE; i++)
+    {
+        inflight_t * p_probe = &m_inflight[(msg_id + i) & (INFLIGHT_SIZE - 1)];
+
+        if (comm_op_none == p_probe->op)
+        {
+            p_entry = p_probe;
+            break;
+        }
+
+        if (   NULL == p_expired
+            && app_timer_cnt_diff_compute(now, p_probe->deadline)
+                                                    < INFLIGHT_TICKS_HALF_RANGE)
+        {
+            p_expired = p_probe;
+        }
+    }
+
+    if (NULL == p_entry)
+        p_entry = p_expired;
+
+    if (NULL == p_entry)
+    {
+        NRF_LOG_ERROR("MQTT-SN: too many transactions in flight\r\n");
+        return NULL;
+    }
+
+    p_entry->msg_id    = msg_id;
+    p_entry->op        = op;
+    p_entry->owner_cb  = owner_cb;
+    p_entry->p_context = p_context;
+    p_entry->deadline  = now + APP_TIMER_TICKS(INFLIGHT_DEADLINE_MS);
+
+    return p_entry;
+}
+
+
+/**@brief Opens the reserved transaction with the ID of the message sent.
+ */
+static void inflight_commit(inflight_t * p_entry, uint16_t msg_id)
+{
+    p_entry->msg_id    = msg_id;
+    m_inflight_next_id = msg_id + 1;
+
+    poll_update();
+}
+
+
+/**@brief Releases the reserved transaction of the message not sent.
+ */
+static void inflight_release(inflight_t * p_entry)
+{
+    p_entry->op = comm_op_none;
+}
+
+
+int8_t comm_manager_inflight_resolve(mqttsn_event_t * p_event)
+{
+    comm_manager_op_t op;
+    uint16_t          msg_id;
+
+    switch (p_event->event_id)
+    {
+        case MQTTSN_EVENT_REGISTERED:
+            op     = comm_op_register;
+            msg_id = p_event->event_data.registered.packet.id;
+        break;
+
+        case MQTTSN_EVENT_SUBSCRIBED:
+            op     = comm_op_subscribe;
+            msg_id = p_event->event_data.subscribed.packet.id;
+        break;
+
+        case MQTTSN_EVENT_UNSUBSCRIBED:
+            op     = comm_op_unsubscribe;
+            msg_id = p_event->event_data.subscribed.packet.id;
+        break;
+
+        case MQTTSN_EVENT_PUBLISHED:
+            op     = comm_op_publish;
+            msg_id = p_event->event_data.published.packet.id;
+        break;
+
+        case MQTTSN_EVENT_TIMEOUT:
+            msg_id = p_event->event_data.error.msg_id;
+
+            switch (p_event->event_data.error.msg_type)
+            {
+                case MQTTSN_PACKET_REGACK:   op = comm_op_register;    break;
+                case MQTTSN_PACKET_SUBACK:   op = comm_op_subscribe;   break;
+                case MQTTSN_PACKET_UNSUBACK: op = comm_op_unsubscribe; break;
+                case MQTTSN_PACKET_PUBACK:   op = comm_op_publish;     break;
+                default:
+                    return CONN_MGR_NO_TRANSACTION;
+            }
+        break;
+
+        default:
+            return CONN_MGR_NO_TRANSACTION;
+    }
+
+    inflight_t * p_entry = inflight_find(msg_id, op);
+
+    if (NULL == p_entry)
+        return CONN_MGR_NO_TRANSACTION;
+
+    comm_manager_ack_cb owner_cb  = p_entry->owner_cb;
+    void              * p_context = p_entry->p_context;
+
+    // the owner might open the next transaction right away (retry)
+    p_entry->op = comm_op_none;
+
+    int8_t err_code = CONN_MGR_SUCCESS;
+
+    if (NULL != owner_cb)
+        err_code = owner_cb(p_event, p_context);
+
+    poll_update();
+    return err_code;
+}
+
+
+bool comm_manager_is_idle(void)
+{
+    return    0 == inflight_count()
+           && 0 == m_publish_stats.depth;
+}
+
+
+/***************************************************************************************************
+ * @section Publish queue
+ **************************************************************************************************/
+
+
+static void publish_pump(void);
+
+
+static void publish_entry_free(publish_entry_t * p_entry)
+{
+    if (p_entry->is_in_flight)
+        m_publish_stats.in_flight--;
+
+    memset(p_entry, 0, sizeof(publish_entry_t));
+    m_publish_stats.depth--;
+}
+
+
+/**@brief Prepares the queue for the new session.
+ *
+ * @details PUBACKs of the previous session will never come, so the publishes
+ * are sent once again. The topic IDs are lost with the clean session.
+ */
+static void publish_queue_reset(bool clean_session)
+{
+    for (uint8_t i = 0; i < PUBLISH_QUEUE_SIZE; i++)
+    {
+        publish_entry_t * p_entry = &m_publish_queue[i];
+
+        if (0 == p_entry->topic_id)
+            continue;
+
+        if (clean_session)
+        {
+            m_publish_stats.dropped++;
+            publish_entry_free(p_entry);
+        }
+        else if (p_entry->is_in_flight)
+        {
+            p_entry->is_in_flight = false;
+            m_publish_stats.in_flight--;
+        }
+    }
+}
+
+
+/**@brief Owner of the QoS1 publishes - PUBACK or timeout.
+ */
+static int8_t publish_ack_handler(mqttsn_event_t * p_event, void * p_context)
+{
+    publish_entry_t * p_entry = (publish_entry_t *) p_context;
+
+    if (   0 == p_entry->topic_id
+        || false == p_entry->is_in_flight)
+        return -1;
+
+    if (MQTTSN_EVENT_TIMEOUT == p_event->event_id)
+    {
+        // the newer value (if any) is queued anyway
+        m_publish_stats.dropped++;
+    }
+    else
+    {
+        m_publish_stats.sent++;
+    }
+
+    publish_entry_free(p_entry);
+    publish_pump();
+
+    return CONN_MGR_SUCCESS;
+}
+
+
+/**@brief Sends the oldest publishes till the in-flight limit is reached.
+ */
+static void publish_pump(void)
+{
+    while (m_publish_stats.in_flight < COMM_PUBLISH_INFLIGHT_MAX)
+    {
+        publish_entry_t * p_next = NULL;
+
+        for (uint8_t i = 0; i < PUBLISH_QUEUE_SIZE; i++)
+        {
+            publish_entry_t * p_entry = &m_publish_queue[i];
+
+            if (   0 == p_entry->topic_id
+                || p_entry->is_in_flight)
+                continue;
+
+            // wrap-safe comparison of the sequence numbers
+            if (   NULL == p_next
+                || (int16_t) (p_entry->seq - p_next->seq) < 0)
+            {
+                p_next = p_entry;
+            }
+        }
+
+        if (NULL == p_next)
+            return;
+
+        // the PUBACK could not be matched, wait for the running transactions
+        inflight_t * p_inflight = inflight_reserve(comm_op_publish,
+                                                   publish_ack_handler,
+                                                   p_next);
+        if (NULL == p_inflight)
+            return;
+
+        uint32_t err_code = mqttsn_client_publish(&m_client,
+                                                  p_next->topic_id,
+                                                  p_next->data,
+                                                  p_next->data_len,
+                                                  &p_next->msg_id);
+        if (err_code != NRF_SUCCESS)
+        {
+            NRF_LOG_ERROR("MQTT-SN: publish error: 0x%x\r\n", err_code);
+            inflight_release(p_inflight);
+
+            // the client queue is full - with none of the publishes in flight
+            // no PUBACK would pump the queue again (connect does it anyway)
+            if (comm_manager_is_connected())
+            {
+                app_timer_stop(m_publish_timer);
+                app_timer_start(m_publish_timer,
+                                APP_TIMER_TICKS(PUBLISH_RETRY_MS),
+                                NULL);
+            }
+            return;
+        }
+
+        inflight_commit(p_inflight, p_next->msg_id);
+
+        p_next->is_in_flight = true;
+        m_publish_stats.in_flight++;
+    }
+}
+
+
+static void publish_timer_handler(void * p_context)
+{
+    publish_pump();
+    poll_update();
+}
+
+
+int8_t comm_manager_publish(uint16_t topic_id,
+                            uint8_t const * p_data,
+                            uint16_t data_len)
+{
+    if (   0 == topic_id
+        || NULL == p_data
+        || data_len > COMM_PUBLISH_DATA_MAX)
+        return -1;
+
+    publish_entry_t * p_entry = NULL;
+
+    for (uint8_t i = 0; i < PUBLISH_QUEUE_SIZE; i++)
+    {
+        publish_entry_t * p_probe = &m_publish_queue[i];
+
+        // the value which is not sent yet is superseded
+        if (   topic_id == p_probe->topic_id
+            && false == p_probe->is_in_flight)
+        {
+            p_entry = p_probe;
+            m_publish_stats.coalesced++;
+            break;
+        }
+
+        if (   NULL == p_entry
+            && 0 == p_probe->topic_id)
+        {
+            p_entry = p_probe;
+        }
+    }
+
+    if (NULL == p_entry)
+    {
+        m_publish_stats.dropped++;
+        return -2;
+    }
+
+    if (0 == p_entry->topic_id)
+    {
+        // new entry takes its place at the end of the queue
+        p_entry->topic_id = topic_id;
+        p_entry->seq      = m_publish_seq++;
+
+        m_publish_stats.depth++;
+        if (m_publish_stats.depth > m_publish_stats.depth_max)
+            m_publish_stats.depth_max = m_publish_stats.depth;
+    }
+
+    memcpy(p_entry->data, p_data, data_len);
+    p_entry->data_len = (uint8_t) data_len;
+
+    publish_pump();
+    poll_update();
+    return CONN_MGR_SUCCESS;
+}
+
+
+int8_t comm_manager_publish_stream(uint16_t topic_id,
+                                   uint8_t const * p_data,
+                                   uint16_t data_len,
+                                   comm_manager_ack_cb owner_cb,
+                                   void * p_context)
+{
+    if (   0 == topic_id
+        || NULL == p_data
+        || NULL == owner_cb
+        || data_len > COMM_PUBLISH_STREAM_MAX)
+        return -1;
+
+    if (false == comm_manager_is_connected())
+        return -2;
+
+    inflight_t * p_inflight = inflight_reserve(comm_op_publish, owner_cb, p_context);
+
+    if (NULL == p_inflight)
+        return -4;
+
+    uint16_t msg_id;
+    uint32_t err_code = mqttsn_client_publish(&m_client,
+                                              topic_id,
+                                              p_data,
+                                              data_len,
+                                              &msg_id);
+    if (err_code != NRF_SUCCESS)
+    {
+        NRF_LOG_ERROR("MQTT-SN: stream publish error: 0x%x\r\n", err_code);
+        inflight_release(p_inflight);
+        return -3;
+    }
+
+    inflight_commit(p_inflight, msg_id);
+    return CONN_MGR_SUCCESS;
+}
+
+
+int8_t comm_manager_publish_qos_negative_one(uint16_t topic_id,
+                                             uint8_t const * p_data,
+                                             uint16_t data_len)
+{
+    if (   0 == topic_id
+        || NULL == p_data
+        || data_len > COMM_PUBLISH_STREAM_MAX)
+        return -1;
+
+    if (false == m_gateway_known)
+        return -2;
+
+    mqttsn_topic_t topic =
+    {
+        .p_topic_name = NULL,
+        .topic_id     = topic_id,
+    };
+
+    uint32_t err_code = mqttsn_client_qos_negative_one_publish(&m_client,
+                                                               &topic,
+                                                               &m_gateway_addr,
+                                                               (uint8_t *) p_data,
+                                                               data_len);
+    if (err_code != NRF_SUCCESS)
+    {
+        NRF_LOG_ERROR("MQTT-SN: QoS -1 publish error: 0x%x\r\n", err_code);
+        return -3;
+    }
+
+    m_publish_stats.unacked++;
+    return CONN_MGR_SUCCESS;
+}
+
+
+const comm_manager_publish_stats_t * comm_manager_publish_stats_get(void)
+{
+    return &m_publish_stats;
+}
+
+
+/***************************************************************************************************
+ * @section Gateways
+ **************************************************************************************************/
+
+
+/**@brief Keeps the RTT estimate of the gateway in use in its entry.
+ */
+static void gateway_save(void)
+{
+    if (m_gateway_idx >= GATEWAY_TABLE_SIZE)
+        return;
+
+    gateway_t * p_gateway = &m_gateways[m_gateway_idx];
+
+    p_gateway->srtt        = m_srtt;
+    p_gateway->rttvar      = m_rttvar;
+    p_gateway->rtt_samples = m_retry_stats.rtt_samples;
+}
+
+
+/**@brief Switches the gateway, the RTT estimator continues with its estimate.
+ */
+static void gateway_use(uint8_t idx)
+{
+    if (idx == m_gateway_idx)
+        return;
+
+    gateway_save();
+
+    gateway_t * p_gateway = &m_gateways[idx];
+
+    memset(&m_retry_stats, 0, sizeof(m_retry_stats));
+    m_srtt                    = p_gateway->srtt;
+    m_rttvar                  = p_gateway->rttvar;
+    m_retry_stats.rtt_samples = p_gateway->rtt_samples;
 
-static mqttsn_client_t      m_client;                                       /**< An MQTT-SN client instance. */
-static mqttsn_remote_t      m_gateway_addr;                                 /**< A gateway address. */
-static uint8_t              m_gateway_id;                                   /**< A gateway ID. */
-static mqttsn_connect_opt_t m_connect_opt;                                  /**< Connect options for the MQTT-SN client. */
+    m_gateway_addr  = p_gateway->addr;
+    m_gateway_id    = p_gateway->id;
+    m_gateway_idx   = idx;
+    m_gateway_known = true;
+}
+
+
+/**@brief Rank of the gateway - the lower, the better [ms].
+ */
+static uint32_t gateway_score(gateway_t const * p_gateway)
+{
+    uint32_t rtt_ms = p_gateway->rtt_samples ? (p_gateway->srtt >> 3)
+                                             : RTO_INITIAL_MS;
 
-// THESE SHOULD BE CHANGED ACCORDING TO PROTOCOL ASSUMPTIONS
-// CLIENT ID IS BASED ON EUI64
+    return rtt_ms + p_gateway->failures * GATEWAY_FAILURE_PENALTY_MS;
+}
 
-static char                 m_client_id[]          = "nRF52840";            /**< The MQTT-SN Client's ID. */
 
-static comm_manager_event_cb m_event_cb[MQTTSN_EVENT_COUNT];
+/**@brief Returns the best gateway other than the excluded one or
+ * GATEWAY_TABLE_SIZE if there is none.
+ */
+static uint8_t gateway_best(uint8_t excluded_idx)
+{
+    uint8_t  best_idx   = GATEWAY_TABLE_SIZE;
+    uint32_t best_score = UINT32_MAX;
+
+    gateway_save();
+
+    for (uint8_t i = 0; i < GATEWAY_TABLE_SIZE; i++)
+    {
+        if (   false == m_gateways[i].is_used
+            || excluded_idx == i)
+            continue;
+
+        uint32_t score = gateway_score(&m_gateways[i]);
+
+        if (score < best_score)
+        {
+            best_score = score;
+            best_idx   = i;
+        }
+    }
+
+    return best_idx;
+}
+
+
+/**@brief Adds the gateway or updates its address.
+ *
+ * @details If the table is full, the worst ranked gateway (not the one in
+ * use) is replaced.
+ */
+static void gateway_add(mqttsn_remote_t const * p_addr, uint8_t id)
+{
+    uint8_t  idx         = GATEWAY_TABLE_SIZE;
+    uint32_t worst_score = 0;
+
+    for (uint8_t i = 0; i < GATEWAY_TABLE_SIZE; i++)
+    {
+        if (   m_gateways[i].is_used
+            && id == m_gateways[i].id)
+        {
+            m_gateways[i].addr = *p_addr;
+
+            if (i == m_gateway_idx)
+                m_gateway_addr = *p_addr;
+
+            return;
+        }
+
+        if (false == m_gateways[i].is_used)
+        {
+            // free entry beats any used one
+            worst_score = UINT32_MAX;
+            idx         = i;
+        }
+        else if (   i != m_gateway_idx
+                 && gateway_score(&m_gateways[i]) >= worst_score)
+        {
+            worst_score = gateway_score(&m_gateways[i]);
+            idx         = i;
+        }
+    }
+
+    if (idx >= GATEWAY_TABLE_SIZE)
+        return;
+
+    memset(&m_gateways[idx], 0, sizeof(gateway_t));
+    m_gateways[idx].addr    = *p_addr;
+    m_gateways[idx].id      = id;
+    m_gateways[idx].is_used = true;
+
+    NRF_LOG_INFO("MQTT-SN: gateway %d added to the table.\r\n", id);
+}
+
+
+/**@brief Stores the gateway in use, unless it is stored already (flash wear).
+ */
+static void gateway_store(void)
+{
+    gateway_record_t record;
+
+    memset(&record, 0, sizeof(record));
+    record.addr = m_gateway_addr;
+    record.id   = m_gateway_id;
+
+    if (0 == memcmp(&record, &m_gateway_record, sizeof(record)))
+        return;
+
+    if (mash_storage_write(storage_gateway, &record, sizeof(record)))
+    {
+        NRF_LOG_ERROR("MQTT-SN: gateway store error\r\n");
+        return;
+    }
+
+    m_gateway_record = record;
+}
+
+
+int8_t comm_manager_gateway_restore(void)
+{
+    gateway_record_t record;
+    uint16_t         length = sizeof(record);
+
+    memset(&record, 0, sizeof(record));
+
+    if (   mash_storage_read(storage_gateway, &record, &length)
+        || length != sizeof(record))
+        return -1;
+
+    m_gateway_record = record;
+
+    gateway_add(&record.addr, record.id);
+
+    // the table keeps the RTT estimate and the failures of the gateway
+    for (uint8_t i = 0; i < GATEWAY_TABLE_SIZE; i++)
+    {
+        if (   m_gateways[i].is_used
+            && record.id == m_gateways[i].id)
+        {
+            gateway_use(i);
+            return CONN_MGR_SUCCESS;
+        }
+    }
+
+    return -2;
+}
+
+
+int8_t comm_manager_gateway_select(void)
+{
+    uint8_t idx = gateway_best(GATEWAY_TABLE_SIZE);
+
+    if (idx >= GATEWAY_TABLE_SIZE)
+        return -1;
+
+    gateway_use(idx);
+    return CONN_MGR_SUCCESS;
+}
+
+
+int8_t comm_manager_gateway_failover(void)
+{
+    if (m_gateway_idx < GATEWAY_TABLE_SIZE)
+    {
+        gateway_t * p_failed = &m_gateways[m_gateway_idx];
+
+        if (p_failed->failures < GATEWAY_FAILURES_MAX)
+            p_failed->failures++;
+    }
+
+    uint8_t idx = gateway_best(m_gateway_idx);
+
+    if (idx >= GATEWAY_TABLE_SIZE)
+        return -1;
+
+    NRF_LOG_INFO("MQTT-SN: failover from gateway %d to %d.\r\n",
+                 m_gateway_id,
+                 m_gateways[idx].id);
+
+    gateway_use(idx);
+    return CONN_MGR_SUCCESS;
+}
+
 
 /***************************************************************************************************
  * @section MQTT-SN handling
@@ -41,15 +858,20 @@ static comm_manager_event_cb m_event_cb[MQTTSN_EVENT_COUNT];
 
 
 /**@brief Initializes MQTT-SN client's connection options.
+ *
+ * @details The client ID is the device ID (base64 of the FICR device address),
+ * so the gateway is able to keep a separate session for each device.
  */
 static void connect_opt_init(void)
 {
+    char * p_client_id = comm_utils_get_id();
+
     m_connect_opt.alive_duration = MQTTSN_DEFAULT_ALIVE_DURATION,
     m_connect_opt.clean_session  = MQTTSN_DEFAULT_CLEAN_SESSION_FLAG,
     m_connect_opt.will_flag      = MQTTSN_DEFAULT_WILL_FLAG,
-    m_connect_opt.client_id_len  = strlen(m_client_id),
+    m_connect_opt.client_id_len  = strlen(p_client_id),
 
-    memcpy(m_connect_opt.p_client_id, (unsigned char *)m_client_id, m_connect_opt.client_id_len);
+    memcpy(m_connect_opt.p_client_id, (unsigned char *)p_client_id, m_connect_opt.client_id_len);
 }
 
 /*
@@ -92,8 +914,21 @@ static void execute_callback(mqttsn_event_t * p_event)
  */
 static void evt_gateway_found(mqttsn_event_t * p_event)
 {
-    m_gateway_addr = *(p_event->event_data.connected.p_gateway_addr);
-    m_gateway_id   = p_event->event_data.connected.gateway_id;
+    // heard in the passive window - no SEARCHGW needed
+    if (m_is_listening)
+    {
+        app_timer_stop(m_listen_timer);
+        m_is_listening = false;
+        m_discovery_stats.heard++;
+    }
+
+    gateway_add(p_event->event_data.connected.p_gateway_addr,
+                p_event->event_data.connected.gateway_id);
+
+    // the gateway in use (or being connected) is kept, the rest is there
+    // for the failover
+    if (comm_manager_is_disconnected())
+        comm_manager_gateway_select();
 
     execute_callback(p_event);
 }
@@ -105,6 +940,16 @@ static void evt_gateway_found(mqttsn_event_t * p_event)
  */
 static void evt_connected(mqttsn_event_t * p_event)
 {
+    // the gateway recovers its rank
+    if (m_gateway_idx < GATEWAY_TABLE_SIZE)
+        m_gateways[m_gateway_idx].failures >>= 1;
+
+    // connected straight away after the next reboot
+    gateway_store();
+
+    // publishes queued while the gateway was away
+    publish_pump();
+    poll_update();
 
     // TODO
     // THIS IS THE PLASE WHERE THE CREATION OF SELF SERVICES WILL BE
@@ -115,6 +960,25 @@ static void evt_connected(mqttsn_event_t * p_event)
 
 /**@brief Processes DISCONNECT message from a gateway. */
 static void evt_disconnect_permit(mqttsn_event_t * p_event)
+{
+    poll_update();
+    execute_callback(p_event);
+}
+
+
+/**@brief Processes DISCONNECT message from a gateway (sleep request accepted).
+ *
+ * @details From now on the gateway buffers the messages for the client.
+ */
+static void evt_sleep_permit(mqttsn_event_t * p_event)
+{
+    poll_update();
+    execute_callback(p_event);
+}
+
+
+/**@brief Processes the end of the sleep (the client is awake or lost the gateway). */
+static void evt_sleep_stop(mqttsn_event_t * p_event)
 {
     execute_callback(p_event);
 }
@@ -198,6 +1062,12 @@ static void evt_timeout(mqttsn_event_t * p_event)
                   p_event->event_data.error.msg_type,
                   p_event->event_data.error.msg_id);
 
+    if (MQTTSN_ERROR_REJECTED_CONGESTION == p_event->event_data.error.error)
+        m_retry_stats.congestions++;
+    else
+        m_retry_stats.timeouts++;
+
+    poll_update();
     execute_callback(p_event);
 }
 
@@ -222,6 +1092,13 @@ static void evt_search_gateway_timeout(mqttsn_event_t * p_event)
 /**@brief Function for handling MQTT-SN events. */
 static void mqttsn_evt_handler(mqttsn_client_t * p_client, mqttsn_event_t * p_event)
 {
+    // anything but the local timeouts came from the gateway
+    if (   MQTTSN_EVENT_TIMEOUT != p_event->event_id
+        && MQTTSN_EVENT_SEARCHGW_TIMEOUT != p_event->event_id)
+    {
+        comm_poll_rx_activity();
+    }
+
     switch(p_event->event_id)
     {
         case MQTTSN_EVENT_GATEWAY_FOUND:
@@ -239,6 +1116,16 @@ static void mqttsn_evt_handler(mqttsn_client_t * p_client, mqttsn_event_t * p_ev
             evt_disconnect_permit(p_event);
         break;
 
+        case MQTTSN_EVENT_SLEEP_PERMIT:
+            NRF_LOG_INFO("MQTT-SN event: Client is asleep.\r\n");
+            evt_sleep_permit(p_event);
+        break;
+
+        case MQTTSN_EVENT_SLEEP_STOP:
+            NRF_LOG_INFO("MQTT-SN event: Client sleep has been stopped.\r\n");
+            evt_sleep_stop(p_event);
+        break;
+
         case MQTTSN_EVENT_REGISTERED:
             NRF_LOG_INFO("MQTT-SN event: Client registered topic.\r\n");
             NRF_LOG_DEBUG("actual pointer %p", p_event);
@@ -292,13 +1179,142 @@ void comm_manager_mqttsn_init(const void * p_transport)
                                            p_transport);
     APP_ERROR_CHECK(err_code);
 
+    comm_utils_id_gen();
     connect_opt_init();
+    inflight_clear();
+
+    err_code = app_timer_create(&m_listen_timer,
+                                APP_TIMER_MODE_SINGLE_SHOT,
+                                listen_timer_handler);
+    APP_ERROR_CHECK(err_code);
+
+    err_code = app_timer_create(&m_publish_timer,
+                                APP_TIMER_MODE_SINGLE_SHOT,
+                                publish_timer_handler);
+    APP_ERROR_CHECK(err_code);
+}
+
+
+/**@brief Function for setting the clean session flag of the next CONNECT.
+ *
+ * @details With the flag cleared the gateway keeps the registered topics and
+ * subscriptions of the previous session.
+ */
+void comm_manager_set_clean_session(bool clean_session)
+{
+    m_connect_opt.clean_session = clean_session;
+}
+
+
+bool comm_manager_get_clean_session(void)
+{
+    return m_connect_opt.clean_session;
+}
+
+
+uint8_t comm_manager_get_gateway_id(void)
+{
+    return m_gateway_id;
+}
+
+
+bool comm_manager_is_connected(void)
+{
+    return MQTTSN_CLIENT_CONNECTED == mqttsn_client_state_get(&m_client);
+}
+
+
+bool comm_manager_is_disconnected(void)
+{
+    return MQTTSN_CLIENT_DISCONNECTED == mqttsn_client_state_get(&m_client);
+}
+
+
+/**@brief Function for feeding the RTT estimator (RFC 6298).
+ */
+void comm_manager_rtt_sample(uint32_t rtt_ms)
+{
+    if (0 == m_retry_stats.rtt_samples)
+    {
+        m_srtt   = rtt_ms << 3;
+        m_rttvar = rtt_ms << 1;
+    }
+    else
+    {
+        // rttvar = 3/4 rttvar + 1/4 |srtt - rtt|, srtt = 7/8 srtt + 1/8 rtt
+        int32_t delta = (int32_t) rtt_ms - (int32_t) (m_srtt >> 3);
+
+        if (delta < 0)
+            delta = -delta;
+
+        m_rttvar += (uint32_t) delta - (m_rttvar >> 2);
+        m_srtt   += rtt_ms - (m_srtt >> 3);
+    }
+
+    if (m_retry_stats.rtt_samples < UINT16_MAX)
+        m_retry_stats.rtt_samples++;
+}
+
+
+uint32_t comm_manager_rto_ms(void)
+{
+    if (0 == m_retry_stats.rtt_samples)
+        return RTO_INITIAL_MS;
+
+    uint32_t rto = (m_srtt >> 3) + m_rttvar;    // srtt + 4 * rttvar
+
+    if (rto < RTO_MIN_MS)
+        return RTO_MIN_MS;
+
+    if (rto > RTO_MAX_MS)
+        return RTO_MAX_MS;
+
+    return rto;
+}
+
+
+uint32_t comm_manager_backoff_ms(uint8_t attempt, bool is_congestion)
+{
+    uint32_t delay = comm_manager_rto_ms();
+
+    // the congested gateway gets one more step of the backoff
+    if (is_congestion)
+        attempt++;
+
+    while (attempt-- && delay < RTO_MAX_MS)
+        delay <<= 1;
+
+    if (delay > RTO_MAX_MS)
+        delay = RTO_MAX_MS;
+
+    // equal jitter - random delay within [delay/2, delay]
+    return delay / 2 + comm_utils_rand() % (delay / 2 + 1);
+}
+
+
+void comm_manager_retry_sent(void)
+{
+    if (m_retry_stats.retries < UINT16_MAX)
+        m_retry_stats.retries++;
 }
 
+
+const comm_manager_retry_stats_t * comm_manager_retry_stats_get(void)
+{
+    return &m_retry_stats;
+}
+
+
 /**@brief Function for searching the MQTTSN gateway.
  */
 void comm_manager_search_gateway(void)
 {
+    if (m_is_listening)
+    {
+        app_timer_stop(m_listen_timer);
+        m_is_listening = false;
+    }
+
     uint32_t err_code = mqttsn_client_search_gateway(&m_client,
                                                      SEARCH_GATEWAY_TIMEOUT);
 
@@ -308,15 +1324,63 @@ void comm_manager_search_gateway(void)
     }
     else
     {
+        m_discovery_stats.searches++;
         NRF_LOG_INFO("MQTT-SN: search gateway sent.");
     }
 }
 
 
+/**@brief Nothing heard in the passive window - search actively.
+ */
+static void listen_timer_handler(void * p_context)
+{
+    if (false == m_is_listening)
+        return;
+
+    m_is_listening = false;
+
+    NRF_LOG_INFO("MQTT-SN: no ADVERTISE heard, searching.\r\n");
+    comm_manager_search_gateway();
+}
+
+
+void comm_manager_discover_gateway(void)
+{
+    if (0 == COMM_ADVERTISE_LISTEN_MS)
+    {
+        comm_manager_search_gateway();
+        return;
+    }
+
+    if (m_is_listening)
+        return;
+
+    uint32_t window_ms = COMM_ADVERTISE_LISTEN_MS
+                       + comm_utils_rand() % (COMM_ADVERTISE_LISTEN_MS / 2 + 1);
+
+    m_is_listening = true;
+    m_discovery_stats.listens++;
+
+    app_timer_start(m_listen_timer, APP_TIMER_TICKS(window_ms), NULL);
+
+    NRF_LOG_INFO("MQTT-SN: listening for the gateway for %d ms.\r\n", window_ms);
+}
+
+
+const comm_manager_discovery_stats_t * comm_manager_discovery_stats_get(void)
+{
+    return &m_discovery_stats;
+}
+
+
 /**@brief Function for connecting to the MQTTSN gateway.
  */
 void comm_manager_connect_to_gateway(void)
 {
+    // acknowledgements of the previous session will never come
+    inflight_clear();
+    publish_queue_reset(m_connect_opt.clean_session);
+
     uint32_t err_code = mqttsn_client_connect(&m_client,
                                               &m_gateway_addr,
                                               m_gateway_id,
@@ -330,29 +1394,67 @@ void comm_manager_connect_to_gateway(void)
     {
         NRF_LOG_INFO("MQTT-SN: connect to gateway sent.");
     }
+
+    poll_update();
+}
+
+
+/**@brief Function for sending the sleep request to the MQTTSN gateway.
+ *
+ * @details DISCONNECT with the sleep duration - the gateway keeps the session
+ * and buffers the messages until the client wakes up (CONNECT).
+ */
+int8_t comm_manager_sleep(uint16_t duration_s)
+{
+    if (false == comm_manager_is_connected())
+        return -1;
+
+    uint32_t err_code = mqttsn_client_sleep(&m_client, duration_s);
+
+    if (err_code != NRF_SUCCESS)
+    {
+        NRF_LOG_ERROR("MQTT-SN: sleep request error: 0x%x\r\n", err_code);
+        return -2;
+    }
+
+    NRF_LOG_INFO("MQTT-SN: sleep request sent (%d s).", duration_s);
+    poll_update();
+    return CONN_MGR_SUCCESS;
 }
 
 
 /**@brief Function for disconnecting from the MQTTSN gateway.
+ *
+ * @details The session is closed by the DISCONNECT permit event (or the
+ * DISCONNECT timeout), not by the return of this function.
+ *
+ * @return CONN_MGR_SUCCESS if the DISCONNECT has been sent, -1 otherwise.
  */
-void comm_manager_disconnect_from_gateway(void)
+int8_t comm_manager_disconnect_from_gateway(void)
 {
     uint32_t err_code = mqttsn_client_disconnect(&m_client);
 
     if (err_code != NRF_SUCCESS)
     {
         NRF_LOG_ERROR("MQTT-SN: disconnect from gateway error: 0x%x\r\n", err_code);
+        return -1;
     }
-    else
-    {
-        NRF_LOG_INFO("MQTT-SN: disconnect from gateway sent.");
-    }
+
+    NRF_LOG_INFO("MQTT-SN: disconnect from gateway sent.");
+    return CONN_MGR_SUCCESS;
 }
 
 
 int8_t comm_manager_topic_register(char * p_topic_name,
-                                   uint16_t * msg_id)
+                                   uint16_t * msg_id,
+                                   comm_manager_ack_cb owner_cb,
+                                   void * p_context)
 {
+    inflight_t * p_inflight = inflight_reserve(comm_op_register, owner_cb, p_context);
+
+    if (NULL == p_inflight)
+        return -1;
+
     uint32_t err_code = mqttsn_client_topic_register(&m_client,
                                          (const uint8_t*)p_topic_name,
                                          strlen(p_topic_name),
@@ -360,19 +1462,27 @@ int8_t comm_manager_topic_register(char * p_topic_name,
     if (err_code != NRF_SUCCESS)
     {
         NRF_LOG_ERROR("MQTT-SN: register error: 0x%x\r\n", err_code);
+        inflight_release(p_inflight);
+        return (int8_t) err_code;
     }
-    else
-    {
-        NRF_LOG_INFO("MQTT-SN: register sent.");
-    }
 
-    return (int8_t) err_code;
+    NRF_LOG_INFO("MQTT-SN: register sent.");
+
+    inflight_commit(p_inflight, *msg_id);
+    return CONN_MGR_SUCCESS;
 }
 
 
 int8_t comm_manager_topic_subscribe(char * p_topic_name,
-                                    uint16_t * msg_id)
+                                    uint16_t * msg_id,
+                                    comm_manager_ack_cb owner_cb,
+                                    void * p_context)
 {
+    inflight_t * p_inflight = inflight_reserve(comm_op_subscribe, owner_cb, p_context);
+
+    if (NULL == p_inflight)
+        return -1;
+
     uint32_t err_code = mqttsn_client_subscribe(&m_client,
                                         (const uint8_t*)p_topic_name,
                                         strlen(p_topic_name),
@@ -380,27 +1490,43 @@ int8_t comm_manager_topic_subscribe(char * p_topic_name,
     if (err_code != NRF_SUCCESS)
     {
         NRF_LOG_ERROR("MQTT-SN: subscribe error: 0x%x\r\n", err_code);
+        inflight_release(p_inflight);
+        return (int8_t) err_code;
     }
-    else
-    {
-        NRF_LOG_INFO("MQTT-SN: subscribe sent.");
-    }
-
-    return (int8_t) err_code;
-}
-
-
-
-
-
 
+    NRF_LOG_INFO("MQTT-SN: subscribe sent.");
 
+    inflight_commit(p_inflight, *msg_id);
+    return CONN_MGR_SUCCESS;
+}
 
 
+int8_t comm_manager_topic_unsubscribe(char * p_topic_name,
+                                      uint16_t * msg_id,
+                                      comm_manager_ack_cb owner_cb,
+                                      void * p_context)
+{
+    inflight_t * p_inflight = inflight_reserve(comm_op_unsubscribe, owner_cb, p_context);
 
+    if (NULL == p_inflight)
+        return -1;
 
+    uint32_t err_code = mqttsn_client_unsubscribe(&m_client,
+                                          (const uint8_t*)p_topic_name,
+                                          strlen(p_topic_name),
+                                          msg_id);
+    if (err_code != NRF_SUCCESS)
+    {
+        NRF_LOG_ERROR("MQTT-SN: unsubscribe error: 0x%x\r\n", err_code);
+        inflight_release(p_inflight);
+        return (int8_t) err_code;
+    }
 
+    NRF_LOG_INFO("MQTT-SN: unsubscribe sent.");
 
+    inflight_commit(p_inflight, *msg_id);
+    return CONN_MGR_SUCCESS;
+}
 
 
 void comm_manager_set_evt_gateway_found_cb(comm_manager_event_cb cb)
@@ -420,6 +1546,16 @@ void comm_manager_set_evt_disconnect_permit_cb(comm_manager_event_cb cb)
     m_event_cb[MQTTSN_EVENT_DISCONNECT_PERMIT] = cb;
 }
 
+void comm_manager_set_evt_sleep_permit_cb(comm_manager_event_cb cb)
+{
+    m_event_cb[MQTTSN_EVENT_SLEEP_PERMIT] = cb;
+}
+
+void comm_manager_set_evt_sleep_stop_cb(comm_manager_event_cb cb)
+{
+    m_event_cb[MQTTSN_EVENT_SLEEP_STOP] = cb;
+}
+
 void comm_manager_set_evt_registered_cb(comm_manager_event_cb cb)
 {
     m_event_cb[MQTTSN_EVENT_REGISTERED] = cb;
@@ -8,6 +8,10 @@
 #ifndef APP_COMM_MANAGER_H_
 #define APP_COMM_MANAGER_H_
 
+/* GCC */
+#include <stdbool.h>
+#include <stdint.h>
+
 /* SDK */
 #include "mqttsn_client.h"
 
@@ -16,10 +20,76 @@
 
 
 #define CONN_MGR_SUCCESS         0
+#define CONN_MGR_NO_TRANSACTION  (-20)
+
+
+#define COMM_PUBLISH_DATA_MAX        16  /**< Max payload of the queued publish [B]. */
+#define COMM_PUBLISH_INFLIGHT_MAX    2   /**< Queued QoS1 publishes awaiting PUBACK at once. */
+#define COMM_PUBLISH_STREAM_MAX      64  /**< Max payload of the stream publish, single 802.15.4 frame with the compressed headers [B]. */
+
+/*
+ * Passive discovery mode (opt-in) - the gateway is first awaited with
+ * ADVERTISE (or GWINFO broadcast in response to SEARCHGW of other node),
+ * SEARCHGW is sent only if nothing is heard. Set above the ADVERTISE period
+ * configured on the gateway (often 15 minutes or more), otherwise the window
+ * only delays the search. 0 - SEARCHGW right away
+ */
+#ifndef COMM_ADVERTISE_LISTEN_MS
+#define COMM_ADVERTISE_LISTEN_MS 0
+#endif
+
+
+/**@brief Counters of the outbound publish queue.
+ */
+typedef struct {
+    uint8_t  depth;             /**< Publishes queued (in flight included). */
+    uint8_t  depth_max;         /**< High watermark of the depth. */
+    uint8_t  in_flight;         /**< QoS1 publishes awaiting PUBACK. */
+    uint16_t sent;              /**< Publishes acknowledged by the gateway. */
+    uint16_t coalesced;         /**< Queued values superseded by the newer ones. */
+    uint16_t dropped;           /**< Publishes rejected (queue full or timed out). */
+    uint16_t unacked;           /**< QoS -1 publishes sent. */
+} comm_manager_publish_stats_t;
+
+
+/**@brief Counters of the gateway discovery.
+ */
+typedef struct {
+    uint16_t listens;           /**< Passive listen windows started. */
+    uint16_t heard;             /**< Gateways found without SEARCHGW. */
+    uint16_t searches;          /**< SEARCHGW sent. */
+} comm_manager_discovery_stats_t;
+
+
+/**@brief Operations awaiting the acknowledgement from the gateway.
+ */
+typedef enum {
+    comm_op_register = 0,
+    comm_op_subscribe,
+    comm_op_unsubscribe,
+    comm_op_publish,
+    comm_op_none
+} comm_manager_op_t;
+
+
+/**@brief Retransmission counters of the current gateway.
+ */
+typedef struct {
+    uint16_t timeouts;          /**< Retransmission limit reached by the client. */
+    uint16_t congestions;       /**< Messages rejected due to the congestion. */
+    uint16_t retries;           /**< Retransmissions sent after the backoff. */
+    uint16_t rtt_samples;       /**< Acknowledgements measured by the estimator. */
+} comm_manager_retry_stats_t;
 
 
 typedef int8_t (*comm_manager_event_cb) (mqttsn_event_t * p_event);
 
+/**@brief Owner of the transaction - called with the acknowledgement or the
+ * timeout (MQTTSN_EVENT_TIMEOUT) of the message.
+ */
+typedef int8_t (*comm_manager_ack_cb) (mqttsn_event_t * p_event,
+                                       void * p_context);
+
 
 /**@brief Function for initializing the MQTTSN client.
  */
@@ -27,9 +97,83 @@ void comm_manager_mqttsn_init(const void * p_transport);
 
 void comm_manager_search_gateway(void);
 
+/**@brief Function for discovering the MQTTSN gateway.
+ *
+ * @details Listens for COMM_ADVERTISE_LISTEN_MS (plus the random part, so the
+ * nodes booted together do not search at once) and searches actively only if
+ * no gateway is heard. MQTTSN_EVENT_GATEWAY_FOUND is passed in both cases.
+ * The search starts right away if COMM_ADVERTISE_LISTEN_MS is 0.
+ */
+void comm_manager_discover_gateway(void);
+
+const comm_manager_discovery_stats_t * comm_manager_discovery_stats_get(void);
+
 void comm_manager_connect_to_gateway(void);
 
-void comm_manager_disconnect_from_gateway(void);
+int8_t comm_manager_disconnect_from_gateway(void);
+
+/**@brief Function for requesting the sleep of the client.
+ *
+ * @details MQTTSN_EVENT_SLEEP_PERMIT is passed when the gateway accepts it.
+ * The client wakes up with comm_manager_connect_to_gateway().
+ */
+int8_t comm_manager_sleep(uint16_t duration_s);
+
+void comm_manager_set_clean_session(bool clean_session);
+
+bool comm_manager_get_clean_session(void);
+
+uint8_t comm_manager_get_gateway_id(void);
+
+/**@brief Function for choosing the best known gateway.
+ *
+ * @details Gateways found with the search are ranked with their RTT estimate
+ * and the failure history.
+ *
+ * @return CONN_MGR_SUCCESS or -1 if no gateway is known.
+ */
+int8_t comm_manager_gateway_select(void);
+
+/**@brief Function for switching to the next gateway after the failure of
+ * the one in use (the failure lowers its rank).
+ *
+ * @return CONN_MGR_SUCCESS or -1 if no other gateway is known.
+ */
+int8_t comm_manager_gateway_failover(void);
+
+/**@brief Function for restoring the gateway of the previous boot.
+ *
+ * @details The last gateway which accepted the CONNECT is kept in the flash,
+ * so it is connected without SEARCHGW.
+ *
+ * @return CONN_MGR_SUCCESS or negative value if no gateway is stored.
+ */
+int8_t comm_manager_gateway_restore(void);
+
+/**@brief Function for feeding the RTT estimator with a measured round trip.
+ *
+ * @details Only first transmissions should be measured (Karn's algorithm).
+ */
+void comm_manager_rtt_sample(uint32_t rtt_ms);
+
+/**@brief Function for getting the retransmission timeout of the gateway [ms].
+ */
+uint32_t comm_manager_rto_ms(void);
+
+/**@brief Function for getting the delay of the next retransmission [ms].
+ *
+ * @details Exponential backoff from the RTO with a random jitter, so the
+ * devices which lost the gateway at once do not retry in lockstep.
+ */
+uint32_t comm_manager_backoff_ms(uint8_t attempt, bool is_congestion);
+
+/**@brief Function for counting the retransmission in the statistics.
+ *
+ * @details Called once the delayed retransmission has been sent.
+ */
+void comm_manager_retry_sent(void);
+
+const comm_manager_retry_stats_t * comm_manager_retry_stats_get(void);
 
 void comm_manager_set_evt_gateway_found_cb(comm_manager_event_cb cb);
 
@@ -37,6 +181,10 @@ void comm_manager_set_evt_connected_cb(comm_manager_event_cb cb);
 
 void comm_manager_set_evt_disconnect_permit_cb(comm_manager_event_cb cb);
 
+void comm_manager_set_evt_sleep_permit_cb(comm_manager_event_cb cb);
+
+void comm_manager_set_evt_sleep_stop_cb(comm_manager_event_cb cb);
+
 void comm_manager_set_evt_registered_cb(comm_manager_event_cb cb);
 
 void comm_manager_set_evt_published_cb(comm_manager_event_cb cb);
@@ -52,16 +200,92 @@ void comm_manager_set_evt_timeout_cb(comm_manager_event_cb cb);
 void comm_manager_set_evt_gateway_search_timeout_cb(comm_manager_event_cb cb);
 
 /**@brief Function for register the MQTTSN topic to the gateway.
+ *
+ * @details The REGACK (or the timeout) is passed to the owner_cb.
  */
 int8_t comm_manager_topic_register(char * p_topic_name,
-                                   uint16_t * msg_id);
+                                   uint16_t * msg_id,
+                                   comm_manager_ack_cb owner_cb,
+                                   void * p_context);
 
 /**@brief Function for subscribe to MQTTSN topic.
+ *
+ * @details The SUBACK (or the timeout) is passed to the owner_cb.
  */
 int8_t comm_manager_topic_subscribe(char * p_topic_name,
-                                    uint16_t * msg_id);
+                                    uint16_t * msg_id,
+                                    comm_manager_ack_cb owner_cb,
+                                    void * p_context);
 
+/**@brief Function for unsubscribe from MQTTSN topic.
+ *
+ * @details The UNSUBACK (or the timeout) is passed to the owner_cb.
+ */
+int8_t comm_manager_topic_unsubscribe(char * p_topic_name,
+                                      uint16_t * msg_id,
+                                      comm_manager_ack_cb owner_cb,
+                                      void * p_context);
 
+/**@brief Function for queueing the publish on the registered topic.
+ *
+ * @details Latest value wins - the value queued for the topic is replaced
+ * until it is sent, so only the current state goes on air. Up to
+ * COMM_PUBLISH_INFLIGHT_MAX publishes await PUBACK at once.
+ */
+int8_t comm_manager_publish(uint16_t topic_id,
+                            uint8_t const * p_data,
+                            uint16_t data_len);
+
+/**@brief Function for publishing the part of the stream (QoS 1).
+ *
+ * @details Bypasses the queue, so the payload is not limited to
+ * COMM_PUBLISH_DATA_MAX and the consecutive parts on the same topic are not
+ * coalesced. The PUBACK (or the timeout) is passed to the owner_cb, which
+ * sends the next part. Requires the connection to the gateway.
+ */
+int8_t comm_manager_publish_stream(uint16_t topic_id,
+                                   uint8_t const * p_data,
+                                   uint16_t data_len,
+                                   comm_manager_ack_cb owner_cb,
+                                   void * p_context);
+
+/**@brief Function for publishing with QoS -1 on the predefined topic.
+ *
+ * @details Connectionless - only the gateway address has to be known (GWINFO),
+ * so the sensor node reports without keeping the session alive. This is the
+ * fire and forget path: the SDK client sends every other PUBLISH with QoS 1,
+ * so there is no QoS 0 publish. The payload is limited to
+ * COMM_PUBLISH_STREAM_MAX.
+ */
+int8_t comm_manager_publish_qos_negative_one(uint16_t topic_id,
+                                             uint8_t const * p_data,
+                                             uint16_t data_len);
+
+const comm_manager_publish_stats_t * comm_manager_publish_stats_get(void);
+
+/**@brief Function for checking if the client is connected to the gateway.
+ */
+bool comm_manager_is_connected(void);
+
+/**@brief Function for checking if the client has no session with any gateway
+ * and none is being set up (CONNECT, DISCONNECT or sleep in progress).
+ */
+bool comm_manager_is_disconnected(void);
+
+/**@brief Function for passing the acknowledgement to the owner of the transaction.
+ *
+ * @details Accepts REGISTERED, SUBSCRIBED, UNSUBSCRIBED, PUBLISHED and TIMEOUT
+ * events, should be called from the scheduler context. The transaction is
+ * closed before the owner is called.
+ *
+ * @return Return value of the owner or CONN_MGR_NO_TRANSACTION.
+ */
+int8_t comm_manager_inflight_resolve(mqttsn_event_t * p_event);
+
+/**@brief Function for checking if nothing awaits the acknowledgement and
+ * the publish queue is empty.
+ */
+bool comm_manager_is_idle(void);
 
 
 #endif /* APP_COMM_MANAGER_H_ */
@@ -0,0 +1,134 @@
+/*
+ * comm_poll.c
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: MSc Patryk Silkowski
+ */
+
+#include "comm_poll.h"
+
+/* GCC */
+#include <stdbool.h>
+#include <stddef.h>
+
+/* SDK */
+#include "app_timer.h"
+#include "nrf_log.h"
+
+#include <openthread/link.h>
+
+
+#define POLL_TICKS_TO_MS(ticks)                                               \
+        ((uint32_t) (((uint64_t) (ticks) * 1000                               \
+                      * (APP_TIMER_CONFIG_RTC_FREQUENCY + 1))                 \
+                     / APP_TIMER_CLOCK_FREQ))
+
+
+APP_TIMER_DEF(m_rx_hold_timer);
+
+static otInstance        * mp_instance = NULL;
+static uint32_t            m_period_ms[comm_poll_level_cnt];
+static comm_poll_level_t   m_level = comm_poll_idle;
+static uint32_t            m_level_since;       // app_timer ticks
+static uint8_t             m_pending_cnt = 0;
+static bool                m_rx_hold = false;
+static comm_poll_stats_t   m_stats;
+
+
+static void poll_level_set(comm_poll_level_t level)
+{
+    uint32_t now = app_timer_cnt_get();
+
+    m_stats.time_ms[m_level] +=
+            POLL_TICKS_TO_MS(app_timer_cnt_diff_compute(now, m_level_since));
+
+    m_level       = level;
+    m_level_since = now;
+    m_stats.decisions[level]++;
+
+    if (OT_ERROR_NONE != otLinkSetPollPeriod(mp_instance, m_period_ms[level]))
+    {
+        m_stats.errors++;
+        NRF_LOG_ERROR("Poll: period %d ms rejected\r\n", m_period_ms[level]);
+    }
+}
+
+
+static void poll_evaluate(void)
+{
+    comm_poll_level_t level = comm_poll_idle;
+
+    if (m_pending_cnt)
+        level = comm_poll_fast;
+    else if (m_rx_hold)
+        level = comm_poll_rx;
+
+    if (level != m_level)
+        poll_level_set(level);
+}
+
+
+static void rx_hold_timer_handler(void * p_context)
+{
+    m_rx_hold = false;
+    poll_evaluate();
+}
+
+
+int8_t comm_poll_init(void * p_instance, uint32_t idle_period_ms)
+{
+    if (NULL == p_instance)
+        return -1;
+
+    if (app_timer_create(&m_rx_hold_timer,
+                         APP_TIMER_MODE_SINGLE_SHOT,
+                         rx_hold_timer_handler))
+        return -2;
+
+    m_period_ms[comm_poll_idle] = idle_period_ms;
+    m_period_ms[comm_poll_rx]   = COMM_POLL_RX_MS;
+    m_period_ms[comm_poll_fast] = COMM_POLL_FAST_MS;
+
+    mp_instance   = (otInstance *) p_instance;
+    m_level       = comm_poll_idle;
+    m_level_since = app_timer_cnt_get();
+
+    return 0;
+}
+
+
+void comm_poll_update(uint8_t pending_cnt)
+{
+    if (NULL == mp_instance)
+        return;
+
+    m_pending_cnt = pending_cnt;
+    poll_evaluate();
+}
+
+
+void comm_poll_rx_activity(void)
+{
+    if (NULL == mp_instance)
+        return;
+
+    // the gateway often sends more (buffered messages, REGISTER + PUBLISH)
+    m_rx_hold = true;
+
+    app_timer_stop(m_rx_hold_timer);
+    app_timer_start(m_rx_hold_timer, APP_TIMER_TICKS(COMM_POLL_RX_HOLD_MS), NULL);
+
+    poll_evaluate();
+}
+
+
+comm_poll_level_t comm_poll_level_get(void)
+{
+    return m_level;
+}
+
+
+const comm_poll_stats_t * comm_poll_stats_get(void)
+{
+    return &m_stats;
+}
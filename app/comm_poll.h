@@ -0,0 +1,61 @@
+/*
+ * comm_poll.h
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: MSc Patryk Silkowski
+ */
+
+#ifndef APP_COMM_POLL_H_
+#define APP_COMM_POLL_H_
+
+/* GCC */
+#include <stdint.h>
+
+
+#define COMM_POLL_FAST_MS           100     /**< Poll period with the transactions pending [ms]. */
+#define COMM_POLL_RX_MS             300     /**< Poll period after the downlink message [ms]. */
+#define COMM_POLL_RX_HOLD_MS        3000    /**< Time the downlink keeps the RX period [ms]. */
+
+
+/*
+ * Poll period levels, the highest one matching the state is applied
+ */
+typedef enum {
+    comm_poll_idle,
+    comm_poll_rx,
+    comm_poll_fast,
+    comm_poll_level_cnt
+} comm_poll_level_t;
+
+typedef struct {
+    uint16_t decisions[comm_poll_level_cnt];    /**< Switches to the level. */
+    uint32_t time_ms[comm_poll_level_cnt];      /**< Time spent at the level (until the last switch). */
+    uint16_t errors;                            /**< Poll period rejected by the stack. */
+} comm_poll_stats_t;
+
+
+/**@brief Function for initializing the poll period governor.
+ *
+ * @details Only the Sleepy End Device polls - the governor is not initialized
+ * otherwise and the calls below have no effect.
+ *
+ * @param[in] p_instance     OpenThread instance.
+ * @param[in] idle_period_ms Poll period with nothing pending.
+ */
+int8_t comm_poll_init(void * p_instance, uint32_t idle_period_ms);
+
+/**@brief Function for passing the amount of the MQTT-SN work pending
+ * (transactions in flight, queued publishes, connection in progress).
+ */
+void comm_poll_update(uint8_t pending_cnt);
+
+/**@brief Function for noting the message received from the gateway.
+ */
+void comm_poll_rx_activity(void);
+
+comm_poll_level_t comm_poll_level_get(void);
+
+const comm_poll_stats_t * comm_poll_stats_get(void);
+
+
+#endif /* APP_COMM_POLL_H_ */
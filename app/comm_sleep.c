@@ -0,0 +1,169 @@
+/*
+ * comm_sleep.c
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: MSc Patryk Silkowski
+ */
+
+#include "comm_sleep.h"
+
+/* GCC */
+#include <stddef.h>
+
+/* SDK */
+#include "app_timer.h"
+#include "nrf_log.h"
+
+/* APP */
+#include "comm_manager.h"
+
+
+#define SLEEP_TICKS_TO_MS(ticks)                                              \
+        ((uint32_t) (((uint64_t) (ticks) * 1000                               \
+                      * (APP_TIMER_CONFIG_RTC_FREQUENCY + 1))                 \
+                     / APP_TIMER_CLOCK_FREQ))
+
+#define SLEEP_WAKEUP_MS                                                       \
+        (COMM_SLEEP_DURATION_S * 1000 - COMM_SLEEP_WAKEUP_MARGIN_MS)
+
+
+typedef enum {
+    sleep_awake,
+    sleep_requested,        // DISCONNECT(duration) sent
+    sleep_asleep
+} sleep_state_t;
+
+
+APP_TIMER_DEF(m_idle_timer);
+APP_TIMER_DEF(m_wakeup_timer);
+
+static sleep_state_t        m_state = sleep_awake;
+static uint32_t             m_state_since;      // app_timer ticks
+static comm_sleep_wakeup_cb m_wakeup_cb = NULL;
+static comm_sleep_stats_t   m_stats;
+
+
+/*
+ * Accounts the time spent in the current state
+ */
+static void sleep_state_set(sleep_state_t state)
+{
+    uint32_t now     = app_timer_cnt_get();
+    uint32_t elapsed = SLEEP_TICKS_TO_MS(app_timer_cnt_diff_compute(now,
+                                                            m_state_since));
+    if (sleep_asleep == m_state)
+        m_stats.asleep_ms += elapsed;
+    else
+        m_stats.awake_ms  += elapsed;
+
+    m_state       = state;
+    m_state_since = now;
+}
+
+
+static void idle_timer_handler(void * p_context)
+{
+    if (sleep_awake != m_state)
+        return;
+
+    // something is still awaiting the acknowledgement
+    if (   false == comm_manager_is_connected()
+        || false == comm_manager_is_idle())
+    {
+        comm_sleep_activity();
+        return;
+    }
+
+    if (CONN_MGR_SUCCESS == comm_manager_sleep(COMM_SLEEP_DURATION_S))
+        sleep_state_set(sleep_requested);
+}
+
+
+static void wakeup_timer_handler(void * p_context)
+{
+    comm_sleep_wakeup();
+}
+
+
+int8_t comm_sleep_init(comm_sleep_wakeup_cb wakeup_cb)
+{
+    if (NULL == wakeup_cb)
+        return -1;
+
+    if (app_timer_create(&m_idle_timer,
+                         APP_TIMER_MODE_SINGLE_SHOT,
+                         idle_timer_handler))
+        return -2;
+
+    if (app_timer_create(&m_wakeup_timer,
+                         APP_TIMER_MODE_SINGLE_SHOT,
+                         wakeup_timer_handler))
+        return -3;
+
+    m_wakeup_cb   = wakeup_cb;
+    m_state       = sleep_awake;
+    m_state_since = app_timer_cnt_get();
+
+    return 0;
+}
+
+
+void comm_sleep_activity(void)
+{
+    if (NULL == m_wakeup_cb)
+        return;
+
+    // the gateway answered instead of accepting the sleep
+    if (sleep_requested == m_state)
+        sleep_state_set(sleep_awake);
+
+    if (sleep_awake != m_state)
+        return;
+
+    app_timer_stop(m_idle_timer);
+    app_timer_start(m_idle_timer, APP_TIMER_TICKS(COMM_SLEEP_IDLE_MS), NULL);
+}
+
+
+void comm_sleep_permit(void)
+{
+    if (NULL == m_wakeup_cb)
+        return;
+
+    app_timer_stop(m_idle_timer);
+    sleep_state_set(sleep_asleep);
+    m_stats.sleeps++;
+
+    app_timer_start(m_wakeup_timer, APP_TIMER_TICKS(SLEEP_WAKEUP_MS), NULL);
+}
+
+
+void comm_sleep_wakeup(void)
+{
+    if (   NULL == m_wakeup_cb
+        || sleep_awake == m_state)
+        return;
+
+    app_timer_stop(m_wakeup_timer);
+    sleep_state_set(sleep_awake);
+    m_stats.wakeups++;
+
+    NRF_LOG_INFO("Sleep: wake up, awake %d ms, asleep %d ms\r\n",
+                 m_stats.awake_ms,
+                 m_stats.asleep_ms);
+
+    // CONNECT ends the sleep, the gateway flushes the buffered messages
+    m_wakeup_cb();
+}
+
+
+bool comm_sleep_is_asleep(void)
+{
+    return sleep_asleep == m_state;
+}
+
+
+const comm_sleep_stats_t * comm_sleep_stats_get(void)
+{
+    return &m_stats;
+}
@@ -0,0 +1,66 @@
+/*
+ * comm_sleep.h
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: MSc Patryk Silkowski
+ */
+
+#ifndef APP_COMM_SLEEP_H_
+#define APP_COMM_SLEEP_H_
+
+/* GCC */
+#include <stdint.h>
+#include <stdbool.h>
+
+
+/*
+ * Sleepy mode - the device is the Thread Sleepy End Device and the MQTT-SN
+ * client sleeps whenever nothing is in flight. The gateway buffers the
+ * messages until the client wakes up (timer or button) and reconnects
+ */
+#ifndef COMM_SLEEP_MODE
+#define COMM_SLEEP_MODE             0
+#endif
+
+#define COMM_SLEEP_DURATION_S       60      /**< Sleep duration announced to the gateway [s]. */
+#define COMM_SLEEP_WAKEUP_MARGIN_MS 2000    /**< Wake up before the gateway considers the client lost [ms]. */
+#define COMM_SLEEP_IDLE_MS          2000    /**< Idle time before the sleep request [ms]. */
+
+
+typedef struct {
+    uint32_t awake_ms;          /**< Time spent awake. */
+    uint32_t asleep_ms;         /**< Time spent asleep (radio off between polls). */
+    uint16_t sleeps;            /**< Sleep requests accepted by the gateway. */
+    uint16_t wakeups;           /**< Wake ups by the timer or the button. */
+} comm_sleep_stats_t;
+
+/**@brief Called when the client has to reconnect (from the scheduler context).
+ */
+typedef void (*comm_sleep_wakeup_cb) (void);
+
+
+/**@brief Function for initializing the sleep timers.
+ */
+int8_t comm_sleep_init(comm_sleep_wakeup_cb wakeup_cb);
+
+/**@brief Function for postponing the sleep request.
+ *
+ * @details Called after each exchange with the gateway - the sleep is
+ * requested COMM_SLEEP_IDLE_MS after the last one, once comm_manager is idle.
+ */
+void comm_sleep_activity(void);
+
+/**@brief Function for handling the MQTTSN_EVENT_SLEEP_PERMIT.
+ */
+void comm_sleep_permit(void);
+
+/**@brief Function for waking up the client - no effect if it is awake.
+ */
+void comm_sleep_wakeup(void);
+
+bool comm_sleep_is_asleep(void);
+
+const comm_sleep_stats_t * comm_sleep_stats_get(void);
+
+
+#endif /* APP_COMM_SLEEP_H_ */
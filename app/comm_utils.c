@@ -9,6 +9,9 @@
 
 static char id[ID_LENGTH] = {0,0,0,0,0,0,0,0,0,0,0,0,0};
 
+static uint32_t rand_state = 1;
+static uint32_t id_hash = 0;
+
 static const unsigned char base64_enc_map[64] =
 {
     'A', 'B', 'C', 'D', 'E', 'F', 'G', 'H', 'I', 'J',
@@ -20,6 +23,26 @@ static const unsigned char base64_enc_map[64] =
     '8', '9', '+', '/'
 };
 
+/*
+ * 127 - not the base64 character, 64 - padding
+ */
+static const unsigned char base64_dec_map[128] =
+{
+    127, 127, 127, 127, 127, 127, 127, 127, 127, 127,
+    127, 127, 127, 127, 127, 127, 127, 127, 127, 127,
+    127, 127, 127, 127, 127, 127, 127, 127, 127, 127,
+    127, 127, 127, 127, 127, 127, 127, 127, 127, 127,
+    127, 127, 127,  62, 127, 127, 127,  63,  52,  53,
+     54,  55,  56,  57,  58,  59,  60,  61, 127, 127,
+    127,  64, 127, 127, 127,   0,   1,   2,   3,   4,
+      5,   6,   7,   8,   9,  10,  11,  12,  13,  14,
+     15,  16,  17,  18,  19,  20,  21,  22,  23,  24,
+     25, 127, 127, 127, 127, 127, 127,  26,  27,  28,
+     29,  30,  31,  32,  33,  34,  35,  36,  37,  38,
+     39,  40,  41,  42,  43,  44,  45,  46,  47,  48,
+     49,  50,  51, 127, 127, 127, 127, 127
+};
+
 
 /*
  * Encode a buffer into base64 format
@@ -89,6 +112,66 @@ int mbedtls_base64_encode(unsigned char *dst, size_t dlen, size_t *olen,
 }
 
 
+/*
+ * Decode a base64-formatted buffer
+ * Strict - no whitespaces, full quads only, the padding at the end only,
+ * no bits beyond the data (the only encoding of the data)
+ */
+int mbedtls_base64_decode(unsigned char *dst, size_t dlen, size_t *olen,
+                          const unsigned char *src, size_t slen )
+{
+    size_t i, n;
+    uint32_t j, x;
+    unsigned char *p;
+
+    if( slen % 4 != 0 )
+        return( -3 );
+
+    /* First pass: check for validity and get output length */
+    for( i = j = 0; i < slen; i++ )
+    {
+        if( src[i] > 127 || base64_dec_map[src[i]] == 127 )
+            return( -3 );
+
+        if( src[i] == '=' && ++j > 2 )
+            return( -3 );
+
+        if( base64_dec_map[src[i]] < 64 && j != 0 )
+            return( -3 );
+    }
+
+    n = ( slen / 4 ) * 3 - j;
+
+    if( ( dlen < n ) || ( NULL == dst ) )
+    {
+        *olen = n;
+        return( -2 );
+    }
+
+    for( j = 3, n = x = 0, p = dst; i > 0; i--, src++ )
+    {
+        j -= ( base64_dec_map[*src] == 64 );
+        x  = ( x << 6 ) | ( base64_dec_map[*src] & 0x3F );
+
+        if( ++n == 4 )
+        {
+            n = 0;
+
+            if( ( j == 2 && ( x & 0x00C0 ) ) || ( j == 1 && ( x & 0xF000 ) ) )
+                return( -3 );
+
+            if( j > 0 ) *p++ = (unsigned char)( x >> 16 );
+            if( j > 1 ) *p++ = (unsigned char)( x >>  8 );
+            if( j > 2 ) *p++ = (unsigned char)( x       );
+        }
+    }
+
+    *olen = p - dst;
+
+    return( 0 );
+}
+
+
 /*
  * External functions
  */
@@ -104,4 +187,49 @@ void comm_utils_id_gen(void)
   size_t len;
   unsigned char *addr = (unsigned char*) NRF_FICR->DEVICEADDR;
   mbedtls_base64_encode((unsigned char*) id, ID_LENGTH, &len, addr, SOC_ADDR_LENGTH);
+
+  // each device gets its own sequence, zero would stall the generator
+  rand_state = NRF_FICR->DEVICEADDR[0] ^ NRF_FICR->DEVICEADDR[1];
+  if (0 == rand_state)
+    rand_state = 1;
+
+  id_hash = NRF_FICR->DEVICEADDR[0] ^ (NRF_FICR->DEVICEADDR[1] * 0x9E3779B9U);
+}
+
+
+/*
+ * Finalizer of MurmurHash3 - the neighbouring device addresses (same batch)
+ * end up in distant slots
+ */
+static uint32_t hash_mix(uint32_t h)
+{
+  h ^= h >> 16;
+  h *= 0x85EBCA6BU;
+  h ^= h >> 13;
+  h *= 0xC2B2AE35U;
+  h ^= h >> 16;
+  return h;
+}
+
+
+uint32_t comm_utils_jitter_ms(comm_utils_jitter_stage_t stage)
+{
+  if (COMM_UTILS_FLEET_SIZE <= 1)
+    return 0;
+
+  uint32_t h = hash_mix(id_hash + (uint32_t) stage * 0x9E3779B9U);
+
+  uint32_t slot   = h % COMM_UTILS_FLEET_SIZE;
+  uint32_t offset = (h >> 16) % COMM_UTILS_JITTER_SLOT_MS;
+
+  return slot * COMM_UTILS_JITTER_SLOT_MS + offset;
+}
+
+
+uint32_t comm_utils_rand(void)
+{
+  rand_state ^= rand_state << 13;
+  rand_state ^= rand_state >> 17;
+  rand_state ^= rand_state << 5;
+  return rand_state;
 }
@@ -1,11 +1,57 @@
 #ifndef APP_COMM_UTILS_H_
 #define APP_COMM_UTILS_H_
 
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Boot storm mitigation - the devices of the fleet are spread over
+ * COMM_UTILS_FLEET_SIZE slots of COMM_UTILS_JITTER_SLOT_MS, so the window
+ * grows with the fleet. Set to 1 to disable the jitter
+ */
+#ifndef COMM_UTILS_FLEET_SIZE
+#define COMM_UTILS_FLEET_SIZE       32
+#endif
+
+#define COMM_UTILS_JITTER_SLOT_MS   100
+
+/*
+ * Each stage takes its own slot, so the devices which collided in one stage
+ * are separated in the next one
+ */
+typedef enum {
+  comm_jitter_search,
+  comm_jitter_connect,
+  comm_jitter_provision
+} comm_utils_jitter_stage_t;
 
 char * comm_utils_get_id(void);
 
 void comm_utils_id_gen(void);
 
+/*
+ * Pseudo-random numbers for the jitter (xorshift32 seeded with the device
+ * address), not suitable for cryptography
+ */
+uint32_t comm_utils_rand(void);
+
+/*
+ * Delay of the stage derived from the device ID - the same after each boot,
+ * in range 0 - COMM_UTILS_FLEET_SIZE * COMM_UTILS_JITTER_SLOT_MS [ms]
+ */
+uint32_t comm_utils_jitter_ms(comm_utils_jitter_stage_t stage);
+
+/*
+ * Base64 (mbedtls), the encoder terminates the output with '\0'
+ * Returns 0 on success, -2 if dst is too small (olen - required size),
+ * -3 if the input is not a valid base64 (decoder only)
+ */
+int mbedtls_base64_encode(unsigned char *dst, size_t dlen, size_t *olen,
+                          const unsigned char *src, size_t slen );
+
+int mbedtls_base64_decode(unsigned char *dst, size_t dlen, size_t *olen,
+                          const unsigned char *src, size_t slen );
+
 
 
 #endif /* APP_COMM_UTILS_H_ */
@@ -14,6 +14,7 @@
 /* SDK */
 #include "app_scheduler.h"
 #include "app_timer.h"
+#include "app_util.h"
 #include "bsp_thread.h"
 #include "nrf_log.h"
 #include "nrf_log_ctrl.h"
@@ -25,11 +26,16 @@
 #include <openthread/joiner.h>
 
 /* APP */
+#include "comm_event.h"
 #include "comm_manager.h"
+#include "comm_poll.h"
+#include "comm_sleep.h"
 #include "comm_utils.h"
+#include "mash_storage.h"
 #include "service_bsp.h"
 #include "service_setup.h"
 #include "service_config.h"
+#include "service_dispatch.h"
 
 
 #define VENDOR_NAME   "SIGMA_PS"
@@ -40,17 +46,34 @@
 
 
 #define DEFAULT_CHILD_TIMEOUT  40                                           /**< Thread child timeout [s]. */
-#define DEFAULT_POLL_PERIOD    1000                                         /**< Thread Sleepy End Device polling period when MQTT-SN Asleep. [ms] */
+#define DEFAULT_POLL_PERIOD    1000                                         /**< Thread Sleepy End Device polling period when MQTT-SN is idle or asleep (see comm_poll). [ms] */
 #define NUM_SLAAC_ADDRESSES    4                                            /**< Number of SLAAC addresses. */
 #define OT_JOIN_TRIES          20                                           /**< Amount of attempts to connect to the OT network */
+#define LED_ENDPOINTS_MASK     ((1 << SERVICE_BSP_SW0) - 1)                 /**< LED endpoints in the endpoint bitmask (LED0 - LED3) */
 
 
 #define SCHED_QUEUE_SIZE       8                                            /**< Maximum number of events in the scheduler queue. */
-#define SCHED_EVENT_DATA_SIZE  sizeof(mqttsn_event_t)                       /**< Maximum app_scheduler event size. */
+#define SCHED_EVENT_DATA_SIZE  MAX(APP_TIMER_SCHED_EVENT_DATA_SIZE,          \
+                               sizeof(void *))                              /**< Maximum app_scheduler event size (MQTT-SN events are passed by the pointer). */
 
 #define APP_TIM_JOINER_DELAY 200
 #define APP_TIMER_TICKS_TIMEOUT APP_TIMER_TICKS(50)
 
+#define BOOT_TICKS_TO_MS(ticks)                                               \
+        ((uint32_t) (((uint64_t) (ticks) * 1000                               \
+                      * (APP_TIMER_CONFIG_RTC_FREQUENCY + 1))                 \
+                     / APP_TIMER_CLOCK_FREQ))
+
+/**@brief Milestones of the boot [ms from the timer init], 0 - not reached yet.
+ */
+typedef struct {
+    uint32_t attached_ms;                                                   /**< Thread network attached. */
+    uint32_t gateway_ms;                                                    /**< Gateway restored or found. */
+    uint32_t connected_ms;                                                  /**< CONNACK. */
+    uint32_t ready_ms;                                                      /**< Self services ready. */
+    bool     is_direct;                                                     /**< Connected to the stored gateway (no SEARCHGW). */
+} boot_timeline_t;
+
 static otNetifAddress m_slaac_addresses[NUM_SLAAC_ADDRESSES];               /**< Buffer containing addresses resolved by SLAAC */
 
 static bool g_led_2_on = false;
@@ -59,6 +82,17 @@ static char m_str_eui[17];                                                  /**<
 
 static uint8_t m_ot_join_tries = OT_JOIN_TRIES;                             /**< Down-counter of OT network searching attempts */
 static otDeviceRole m_ot_prev_role = OT_DEVICE_ROLE_DISABLED;               /**< Store device's OT network role */
+static bool m_self_services_ready = false;                                  /**< Self services created, groups are handled */
+
+static bool m_switch_on[SERVICE_BSP_ENDPOINTS];                             /**< Reported states of the switch endpoints */
+static uint8_t m_publish_pending = 0;                                       /**< Endpoints waiting for the onoff REGACK (bitmask) */
+static uint32_t m_endpoint_leds[LED_ENDPOINTS_MASK + 1];                    /**< LED endpoints (bitmask) -> BSP LEDs mask */
+
+static boot_timeline_t m_boot_timeline;                                     /**< Time to connected after reboot */
+
+APP_TIMER_DEF(m_jitter_timer);                                              /**< Delays the stages of the boot (fleet boot storm) */
+static app_sched_event_handler_t m_jitter_handler = NULL;                   /**< Stage awaiting the jitter timer */
+static bool m_failover_pending = false;                                     /**< Failover waits for the DISCONNECT to complete */
 
 /***************************************************************************************************
  * @section scheduler prototypes
@@ -70,10 +104,15 @@ static void sched_mqttsn_gw_search(void * p_event_data, uint16_t event_size);
 static void sched_mqttsn_gw_connect(void * p_event_data, uint16_t event_size);
 static void sched_ot_recommissioning(void * p_event_data, uint16_t event_size);
 static void sched_start_services(void * p_event_data, uint16_t event_size);
-static void sched_registed_service(void * p_event_data, uint16_t event_size);
-static void sched_subscribed_service(void * p_event_data, uint16_t event_size);
-static void sched_timeout_handler(void * p_event_data, uint16_t event_size);
-static void sched_receive_msg_handler(void * p_event_data, uint16_t event_size);
+static void sched_registed_service(mqttsn_event_t * p_evt);
+static void sched_subscribed_service(mqttsn_event_t * p_evt);
+static void sched_unsubscribed_service(mqttsn_event_t * p_evt);
+static void sched_published_handler(mqttsn_event_t * p_evt);
+static void sched_timeout_handler(mqttsn_event_t * p_evt);
+static void sched_receive_msg_handler(mqttsn_event_t * p_evt);
+static void sched_sleep_permit(void * p_event_data, uint16_t event_size);
+static void sched_sleep_stop(void * p_event_data, uint16_t event_size);
+static void sched_gateway_failover(void * p_event_data, uint16_t event_size);
 
 /***************************************************************************************************
  * @section app prototypes
@@ -87,6 +126,55 @@ static void print_ip_info(void);
  **************************************************************************************************/
 
 
+static void jitter_timer_handler(void * p_context)
+{
+    app_sched_event_handler_t handler = m_jitter_handler;
+
+    m_jitter_handler = NULL;
+
+    if (handler)
+    {
+        handler(NULL, 0);
+    }
+}
+
+
+/**@brief Function for scheduling the stage after the delay of the device.
+ *
+ * @details The delay is derived from the device ID (comm_utils_jitter_ms),
+ * so the nodes powered up together reach the gateway one by one. The later
+ * stage replaces the pending one.
+ */
+static uint32_t jitter_sched(comm_utils_jitter_stage_t stage,
+                             app_sched_event_handler_t handler)
+{
+    uint32_t ticks = APP_TIMER_TICKS(comm_utils_jitter_ms(stage));
+
+    app_timer_stop(m_jitter_timer);
+    m_jitter_handler = NULL;
+
+    if (ticks < APP_TIMER_MIN_TIMEOUT_TICKS)
+    {
+        return app_sched_event_put(NULL, 0, handler);
+    }
+
+    m_jitter_handler = handler;
+
+    return app_timer_start(m_jitter_timer, ticks, NULL);
+}
+
+
+/**@brief Function for marking the boot milestone (only the first one counts).
+ */
+static void boot_timeline_mark(uint32_t * p_milestone_ms)
+{
+    if (0 == *p_milestone_ms)
+    {
+        *p_milestone_ms = BOOT_TICKS_TO_MS(app_timer_cnt_get());
+    }
+}
+
+
 /**@brief Function for indicating Thread state change.
  */
 static void thread_state_changed_callback(uint32_t flags, void * p_context)
@@ -117,9 +205,10 @@ static void thread_state_changed_callback(uint32_t flags, void * p_context)
          * If the device has just commissioned and successfully connected to the
          * Thread Network, start to search MQTT-SN gateway
          */
-        uint32_t err_code = app_sched_event_put(NULL,
-                                                0,
-                                                sched_mqttsn_gw_search);
+        boot_timeline_mark(&m_boot_timeline.attached_ms);
+
+        uint32_t err_code = jitter_sched(comm_jitter_search,
+                                         sched_mqttsn_gw_search);
         APP_ERROR_CHECK(err_code);
     }
 
@@ -134,7 +223,8 @@ static void thread_instance_init(void)
 {
     thread_configuration_t thread_configuration =
     {
-        .role                  = RX_ON_WHEN_IDLE,
+        .role                  = COMM_SLEEP_MODE ? RX_OFF_WHEN_IDLE
+                                                 : RX_ON_WHEN_IDLE,
         .autocommissioning     = false,
         .poll_period           = DEFAULT_POLL_PERIOD,
         .default_child_timeout = DEFAULT_CHILD_TIMEOUT,
@@ -392,9 +482,19 @@ static int8_t gateway_search_callback(mqttsn_event_t * p_event)
         break;
 
         case MQTTSN_SEARCH_GATEWAY_NO_GATEWAY_FOUND:
-            ret = (int8_t) app_sched_event_put(NULL,
-                                               0,
-                                               sched_ot_recommissioning);
+            // a gateway known from the previous search might be back
+            if (CONN_MGR_SUCCESS == comm_manager_gateway_select())
+            {
+                ret = (int8_t) app_sched_event_put(NULL,
+                                                   0,
+                                                   sched_mqttsn_gw_connect);
+            }
+            else
+            {
+                ret = (int8_t) app_sched_event_put(NULL,
+                                                   0,
+                                                   sched_ot_recommissioning);
+            }
         break;
 
         default:
@@ -408,39 +508,63 @@ static int8_t gateway_search_callback(mqttsn_event_t * p_event)
 
 static int8_t gateway_found_callback(mqttsn_event_t * p_event)
 {
+    // another gateway is only noted for the failover - also while the
+    // CONNECT to the selected one is pending
+    if (false == comm_manager_is_disconnected())
+        return CONN_MGR_SUCCESS;
+
+    boot_timeline_mark(&m_boot_timeline.gateway_ms);
+
     /**
-     * Just schedule the connection after the successful search
+     * Just schedule the connection after the successful search, all the nodes
+     * got the same GWINFO at once
      */
-    return (int8_t) app_sched_event_put(NULL,
-                                        0,
-                                        sched_mqttsn_gw_connect);
+    return (int8_t) jitter_sched(comm_jitter_connect,
+                                 sched_mqttsn_gw_connect);
 }
 
 
 static int8_t connected_to_gateway_callback(mqttsn_event_t * p_event)
 {
+    boot_timeline_mark(&m_boot_timeline.connected_ms);
+
     /**
-     * Just schedule the service creator startup
+     * Just schedule the service creator startup (REGISTER/SUBSCRIBE burst)
      */
-    return (int8_t) app_sched_event_put(NULL,
-                                        0,
-                                        sched_start_services);
+    return (int8_t) jitter_sched(comm_jitter_provision,
+                                 sched_start_services);
 }
 
 
 static int8_t register_acknowledge_callback(mqttsn_event_t * p_event)
 {
-    NRF_LOG_DEBUG("actual callback pointer %p with sizeof %d", p_event, sizeof(mqttsn_event_t *));
+    const mqttsn_packet_t * p_packet = &p_event->event_data.registered.packet;
+
     /**
-     * Just schedule the register service handler
+     * REGISTER initiated by the gateway (wildcard subscription) is the one
+     * which carries the topic name - the REGACK of ours does not. The MsgIds
+     * of the gateway and ours are independent, so they tell nothing. The
+     * name is valid only within the callback, so parse it right here (not
+     * terminated, its length comes in packet.len)
      */
+    if (   NULL != p_packet->topic.p_topic_name
+        && 0 != p_packet->len)
+    {
+        int8_t err_code = service_learn_topic(
+                p_packet->topic.topic_id,
+                (const char *) p_packet->topic.p_topic_name,
+                p_packet->len);
 
+        if (err_code)
+            NRF_LOG_ERROR("Service: unknown topic registered: %d", err_code);
 
+        return err_code;
+    }
 
-
-    return (int8_t) app_sched_event_put((void const *) p_event,
-                                        sizeof(mqttsn_event_t),
-                                        sched_registed_service);
+    /**
+     * Just schedule the register service handler
+     */
+    return comm_event_sched_put(p_event, sched_registed_service);
 }
 
 
@@ -449,25 +573,69 @@ static int8_t subscription_acknowledge_callback(mqttsn_event_t * p_event)
     /**
      * Just schedule the subscript service handler
      */
-    return (int8_t) app_sched_event_put(p_event,
-                                        sizeof(mqttsn_event_t),
-                                        sched_subscribed_service);
+    return comm_event_sched_put(p_event, sched_subscribed_service);
+}
+
+
+static int8_t unsubscription_acknowledge_callback(mqttsn_event_t * p_event)
+{
+    return comm_event_sched_put(p_event, sched_unsubscribed_service);
+}
+
+
+static int8_t publish_acknowledge_callback(mqttsn_event_t * p_event)
+{
+    return comm_event_sched_put(p_event, sched_published_handler);
 }
 
 
 static int8_t message_timeout_callback(mqttsn_event_t * p_event)
 {
-    return (int8_t) app_sched_event_put(p_event,
-                                        sizeof(mqttsn_event_t *),
-                                        sched_timeout_handler);
+    return comm_event_sched_put(p_event, sched_timeout_handler);
 }
 
 
 static int8_t message_received_callback(mqttsn_event_t * p_event)
 {
-    return (int8_t) app_sched_event_put(p_event,
-                                        sizeof(mqttsn_event_t *),
-                                        sched_receive_msg_handler);
+    return comm_event_sched_put(p_event, sched_receive_msg_handler);
+}
+
+
+static int8_t disconnect_permit_callback(mqttsn_event_t * p_event)
+{
+    if (!m_failover_pending)
+        return 0;
+
+    // the old session is closed - the next gateway can be connected
+    m_failover_pending = false;
+
+    return (int8_t) app_sched_event_put(NULL,
+                                        0,
+                                        sched_gateway_failover);
+}
+
+
+static int8_t sleep_permit_callback(mqttsn_event_t * p_event)
+{
+    return (int8_t) app_sched_event_put(NULL,
+                                        0,
+                                        sched_sleep_permit);
+}
+
+
+static int8_t sleep_stop_callback(mqttsn_event_t * p_event)
+{
+    return (int8_t) app_sched_event_put(NULL,
+                                        0,
+                                        sched_sleep_stop);
+}
+
+
+/**@brief Function for reconnecting after the sleep (scheduler context).
+ */
+static void sleep_wakeup(void)
+{
+    sched_mqttsn_gw_connect(NULL, 0);
 }
 
 
@@ -478,9 +646,29 @@ static void mqttsn_init(void)
     comm_manager_set_evt_connected_cb(connected_to_gateway_callback);
     comm_manager_set_evt_registered_cb(register_acknowledge_callback);
     comm_manager_set_evt_subscribed_cb(subscription_acknowledge_callback);
+    comm_manager_set_evt_unsubscribed_cb(unsubscription_acknowledge_callback);
+    comm_manager_set_evt_published_cb(publish_acknowledge_callback);
     comm_manager_set_evt_timeout_cb(message_timeout_callback);
     comm_manager_set_evt_received_cb(message_received_callback);
+    comm_manager_set_evt_disconnect_permit_cb(disconnect_permit_callback);
+
+    service_config_init();
 
+    int8_t err_code = comm_event_init();
+    APP_ERROR_CHECK(err_code);
+
+    if (COMM_SLEEP_MODE)
+    {
+        comm_manager_set_evt_sleep_permit_cb(sleep_permit_callback);
+        comm_manager_set_evt_sleep_stop_cb(sleep_stop_callback);
+
+        err_code = comm_sleep_init(sleep_wakeup);
+        APP_ERROR_CHECK(err_code);
+
+        // the poll period follows the pending MQTT-SN work
+        err_code = comm_poll_init(thread_ot_instance_get(), DEFAULT_POLL_PERIOD);
+        APP_ERROR_CHECK(err_code);
+    }
 
     comm_manager_mqttsn_init(thread_ot_instance_get());
 }
@@ -490,21 +678,114 @@ static void mqttsn_init(void)
  * @section State
  **************************************************************************************************/
 
-static void publish(void)
+/**@brief Function for publishing the state of the switch endpoint.
+ *
+ * @details If the onoff topic of the endpoint is not registered yet, the
+ * publish is repeated after the REGACK (see publish_pending_flush).
+ */
+static void publish_switch_state(endpoint_t endpoint)
 {
-    //char* pub_data = g_led_2_on ? "1" : "0";
-    /*
-    uint32_t err_code = mqttsn_client_publish(&m_client, m_topic_pub.topic_id,
-        (uint8_t*)pub_data, strlen(pub_data), &m_msg_id);
-    if (err_code != NRF_SUCCESS)
+    uint16_t topic_id;
+    int8_t   err_code = service_topic_id_get(endpoint, onoff, &topic_id);
+
+    if (SERVICE_PENDING_FLAG == err_code)
+    {
+        m_publish_pending |= (1 << endpoint);
+        return;
+    }
+
+    m_publish_pending &= ~(1 << endpoint);
+
+    if (err_code)
     {
-        NRF_LOG_ERROR("PUBLISH message could not be sent. Error code: 0x%x\r\n", err_code)
+        NRF_LOG_ERROR("Service: no topic ID of the switch %d: %d\r\n",
+                      endpoint, err_code);
+        return;
+    }
+
+    const char * p_msg = m_switch_on[endpoint] ? SERVICE_MSG_ON
+                                               : SERVICE_MSG_OFF;
+
+    // the PUBLISH with TopicIdType predefined is sent only with QoS -1, so
+    // the predefined topics are reported even without the session
+    if (SERVICE_PREDEFINED_TOPICS)
+    {
+        err_code = comm_manager_publish_qos_negative_one(topic_id,
+                                                   (uint8_t const *) p_msg,
+                                                   strlen(p_msg));
     }
     else
     {
-        NRF_LOG_INFO("PUBLISH successfully sent.");
+        err_code = comm_manager_publish(topic_id,
+                                        (uint8_t const *) p_msg,
+                                        strlen(p_msg));
+    }
+    if (err_code)
+    {
+        NRF_LOG_ERROR("PUBLISH message could not be queued. Error code: %d\r\n",
+                      err_code);
     }
-    */
+}
+
+
+/**@brief Function for sending the publishes which waited for the REGACK.
+ */
+static void publish_pending_flush(void)
+{
+    for (endpoint_t endpoint = 0; endpoint < SERVICE_BSP_ENDPOINTS; endpoint++)
+    {
+        if (m_publish_pending & (1 << endpoint))
+            publish_switch_state(endpoint);
+    }
+}
+
+
+/**@brief Function for switching the LEDs of all endpoints in the mask at once.
+ *
+ * @details The group can have any members - the switch endpoints are skipped,
+ * the LEDs are set with the single GPIO write.
+ */
+static void endpoints_actuate(endpoint_mask_t endpoints, bool is_on)
+{
+    uint32_t leds = m_endpoint_leds[endpoints & LED_ENDPOINTS_MASK];
+
+    if (is_on)
+        LEDS_ON(leds);
+    else
+        LEDS_OFF(leds);
+}
+
+
+/**@brief Function for handling the received onoff message.
+ */
+static int8_t onoff_receive(endpoint_mask_t endpoints,
+                            const uint8_t * p_data,
+                            uint16_t len)
+{
+    bool is_on;
+
+    if (   strlen(SERVICE_MSG_ON) == len
+        && 0 == memcmp(p_data, SERVICE_MSG_ON, len))
+        is_on = true;
+    else if (   strlen(SERVICE_MSG_OFF) == len
+             && 0 == memcmp(p_data, SERVICE_MSG_OFF, len))
+        is_on = false;
+    else
+        return -2;
+
+    if (0 == endpoints)
+        return -3;
+
+    endpoints_actuate(endpoints, is_on);
+    return 0;
+}
+
+
+static void publish(endpoint_t endpoint)
+{
+    m_switch_on[endpoint] = !m_switch_on[endpoint];
+
+    publish_switch_state(endpoint);
 }
 
 static void bsp_event_handler(bsp_event_t event)
@@ -564,7 +845,10 @@ static void bsp_event_handler(bsp_event_t event)
 
         case BSP_EVENT_KEY_3:
         {
-            publish();
+            publish(SERVICE_BSP_SW3);
+
+            // the publish is queued until the client reconnects
+            comm_sleep_wakeup();
         }
         break;
 
@@ -583,6 +867,11 @@ static void timer_init(void)
 {
     uint32_t err_code = app_timer_init();
     APP_ERROR_CHECK(err_code);
+
+    err_code = app_timer_create(&m_jitter_timer,
+                                APP_TIMER_MODE_SINGLE_SHOT,
+                                jitter_timer_handler);
+    APP_ERROR_CHECK(err_code);
 }
 
 
@@ -590,6 +879,18 @@ static void timer_init(void)
  */
 static void leds_init(void)
 {
+    static const uint32_t led_masks[] = { BSP_LED_0_MASK, BSP_LED_1_MASK,
+                                          BSP_LED_2_MASK, BSP_LED_3_MASK };
+
+    // each mask is the one of its lowest endpoint added to the rest
+    for (endpoint_mask_t endpoints = 1;
+         endpoints <= LED_ENDPOINTS_MASK;
+         endpoints++)
+    {
+        m_endpoint_leds[endpoints] = m_endpoint_leds[endpoints & (endpoints - 1)]
+                                   | led_masks[__builtin_ctz(endpoints)];
+    }
+
     LEDS_CONFIGURE(LEDS_MASK);
     LEDS_OFF(LEDS_MASK);
 }
@@ -616,6 +917,15 @@ static void log_init(void)
 }
 
 
+/**@brief Function for initializing the flash storage.
+ */
+static void storage_init(void)
+{
+    int8_t err_code = mash_storage_init();
+    APP_ERROR_CHECK(err_code);
+}
+
+
 /**@brief Function for initializing scheduler module.
  */
 static void scheduler_init(void)
@@ -636,11 +946,30 @@ static void sched_print_ip(void * p_event_data, uint16_t event_size)
 
 static void sched_mqttsn_gw_search(void * p_event_data, uint16_t event_size)
 {
-    comm_manager_search_gateway();
+    // the gateway of the previous boot first - SEARCHGW if CONNECT fails
+    if (CONN_MGR_SUCCESS == comm_manager_gateway_restore())
+    {
+        if (0 == m_boot_timeline.connected_ms)
+        {
+            boot_timeline_mark(&m_boot_timeline.gateway_ms);
+            m_boot_timeline.is_direct = true;
+        }
+
+        sched_mqttsn_gw_connect(NULL, 0);
+        return;
+    }
+
+    // ADVERTISE first if the listen mode is enabled, then SEARCHGW
+    comm_manager_discover_gateway();
 }
 
 static void sched_mqttsn_gw_connect(void * p_event_data, uint16_t event_size)
 {
+    // resume the previous gateway session if its topic IDs are known
+    bool is_resumable =
+            service_session_is_resumable(comm_manager_get_gateway_id());
+
+    comm_manager_set_clean_session(!is_resumable);
     comm_manager_connect_to_gateway();
 }
 
@@ -649,60 +978,191 @@ static void sched_ot_recommissioning(void * p_event_data, uint16_t event_size)
     thread_detach_and_commission();
 }
 
-static void sched_start_services(void * p_event_data, uint16_t event_size)
+static void sched_sleep_permit(void * p_event_data, uint16_t event_size)
 {
-    int8_t err_code = create_self_services_init();
+    comm_sleep_permit();
 
-    if (err_code)
+    const comm_sleep_stats_t * p_stats = comm_sleep_stats_get();
+
+    NRF_LOG_INFO("Sleep: asleep for %d s, sleeps %d, wake ups %d\r\n",
+                 COMM_SLEEP_DURATION_S,
+                 p_stats->sleeps,
+                 p_stats->wakeups);
+
+    const comm_poll_stats_t * p_poll = comm_poll_stats_get();
+
+    NRF_LOG_INFO("Poll: fast %d ms (%d), rx %d ms (%d), idle %d ms (%d)\r\n",
+                 p_poll->time_ms[comm_poll_fast],
+                 p_poll->decisions[comm_poll_fast],
+                 p_poll->time_ms[comm_poll_rx],
+                 p_poll->decisions[comm_poll_rx],
+                 p_poll->time_ms[comm_poll_idle],
+                 p_poll->decisions[comm_poll_idle]);
+}
+
+/**@brief Function for switching to the next known gateway - the device stays
+ * in the Thread network, the search is started only if there is none.
+ */
+static void sched_gateway_failover(void * p_event_data, uint16_t event_size)
+{
+    // an earlier timeout may have started the failover already
+    m_failover_pending = false;
+
+    // the stored gateway did not answer
+    if (0 == m_boot_timeline.connected_ms)
     {
-        NRF_LOG_ERROR("Service: creator initialize error: %d\r\n", err_code);
+        m_boot_timeline.is_direct  = false;
+        m_boot_timeline.gateway_ms = 0;
+    }
+
+    if (CONN_MGR_SUCCESS == comm_manager_gateway_failover())
+    {
+        sched_mqttsn_gw_connect(NULL, 0);
+    }
+    else
+    {
+        // the gateway was lost just now - no listen window, search at once
+        comm_manager_search_gateway();
+    }
+}
+
+static void sched_sleep_stop(void * p_event_data, uint16_t event_size)
+{
+    // the client is awake (or lost the gateway) - reconnect
+    comm_sleep_wakeup();
+}
+
+static void ext_services_continue(void)
+{
+    int8_t err_code = service_config_continue();
+
+    if (   err_code
+        && SERVICE_CONFIG_ALL_SUBSCRIBED_FLAG != err_code)
+    {
+        NRF_LOG_ERROR("Service: group re-subscription error: %d\r\n", err_code);
     }
 }
 
-static void sched_registed_service(void * p_event_data, uint16_t event_size)
+static void self_services_ready(void)
 {
-    NRF_LOG_DEBUG("actual void pointer %p", p_event_data);
+    m_self_services_ready = true;
+
+    if (0 == m_boot_timeline.ready_ms)
+    {
+        boot_timeline_mark(&m_boot_timeline.ready_ms);
+
+        const comm_manager_discovery_stats_t * p_discovery =
+                                            comm_manager_discovery_stats_get();
+
+        NRF_LOG_INFO("Boot: attached %d ms, gateway %d ms (%s), connected %d ms, ready %d ms\r\n",
+                     m_boot_timeline.attached_ms,
+                     m_boot_timeline.gateway_ms,
+                     m_boot_timeline.is_direct ? "stored" : "discovery",
+                     m_boot_timeline.connected_ms,
+                     m_boot_timeline.ready_ms);
+        NRF_LOG_INFO("Boot: listens %d, heard %d, SEARCHGW %d\r\n",
+                     p_discovery->listens,
+                     p_discovery->heard,
+                     p_discovery->searches);
+    }
 
-    mqttsn_event_t * p_evt = (mqttsn_event_t *) p_event_data;
+    NRF_LOG_INFO("Service: all self functions has been added in %d ms.\r\n",
+                 service_provisioning_time_ms());
 
-    int8_t err_code = service_subscribe_to_registered(
-        p_evt->event_data.registered.packet.id,
-        p_evt->event_data.registered.packet.topic.topic_id);
+    const comm_manager_retry_stats_t * p_stats = comm_manager_retry_stats_get();
+
+    NRF_LOG_INFO("MQTT-SN: RTO %d ms, retries %d, timeouts %d, congestions %d\r\n",
+                 comm_manager_rto_ms(),
+                 p_stats->retries,
+                 p_stats->timeouts,
+                 p_stats->congestions);
+
+    int8_t err_code = service_cache_store(comm_manager_get_gateway_id());
 
     if (err_code)
     {
-        NRF_LOG_DEBUG("actual pointer %p", p_evt);
-        NRF_LOG_ERROR("Service: subscription to registered topic error: %d\r\n",
-                      err_code);
+        NRF_LOG_ERROR("Service: cache store error: %d\r\n", err_code);
     }
+
+    // groups are handled when self functions are ready
+    ext_services_continue();
+    comm_sleep_activity();
 }
 
-static void sched_subscribed_service(void * p_event_data, uint16_t event_size)
+static void sched_start_services(void * p_event_data, uint16_t event_size)
 {
-    mqttsn_event_t * p_evt = (mqttsn_event_t *) p_event_data;
+    uint8_t gateway_id    = comm_manager_get_gateway_id();
+    bool    clean_session = comm_manager_get_clean_session();
+    int8_t  err_code;
 
-    int8_t err_code;
+    m_self_services_ready = false;
+    service_config_resume(clean_session);
 
-    if (p_evt->event_data.registered.packet.topic.topic_id
-                                                    > SERVICE_SELF_TOPIC_ID_MAX)
+    if (clean_session)
     {
-        // handling the subscription for external topic
-        err_code = service_config_add_ext_topic(
-                    p_evt->event_data.registered.packet.topic.topic_id,
-                    p_evt->event_data.registered.packet.id);
+        err_code = create_self_services_init(gateway_id);
     }
     else
     {
-        // handling self subscription
-        err_code = service_insert_to_database(
-                    p_evt->event_data.registered.packet.id,
-                    p_evt->event_data.registered.packet.topic.topic_id);
+        // the gateway keeps the session - create only the missing services
+        err_code = create_self_services_resume(gateway_id);
     }
 
+    if (SERVICE_ALL_REGISTERED_FLAG == err_code)
+    {
+        self_services_ready();
+    }
+    else if (err_code)
+    {
+        NRF_LOG_ERROR("Service: creator initialize error: %d\r\n", err_code);
+    }
+}
+
+static void sched_registed_service(mqttsn_event_t * p_evt)
+{
+    // only the topics the device publishes on are registered
+    int8_t err_code = comm_manager_inflight_resolve(p_evt);
+
+    if (err_code)
+    {
+        NRF_LOG_ERROR("Service: registered topic insertion error: %d\r\n",
+                      err_code);
+    }
+
+    publish_pending_flush();
+}
+
+static void sched_published_handler(mqttsn_event_t * p_evt)
+{
+    int8_t err_code = comm_manager_inflight_resolve(p_evt);
+
+    if (err_code)
+    {
+        NRF_LOG_ERROR("Service: PUBACK handling error: %d\r\n", err_code);
+    }
+
+    const comm_manager_publish_stats_t * p_stats = comm_manager_publish_stats_get();
+
+    NRF_LOG_DEBUG("MQTT-SN: publish queue %d (max %d), coalesced %d, dropped %d\r\n",
+                  p_stats->depth,
+                  p_stats->depth_max,
+                  p_stats->coalesced,
+                  p_stats->dropped);
+
+    comm_sleep_activity();
+}
+
+static void sched_subscribed_service(mqttsn_event_t * p_evt)
+{
+    uint16_t topic_id = p_evt->event_data.subscribed.packet.topic.topic_id;
+
+    // self service or external group - the owner of the SUBSCRIBE knows
+    int8_t err_code = comm_manager_inflight_resolve(p_evt);
+
     if (err_code)
     {
         NRF_LOG_ERROR("Service: subscription of topic with ID:%d returned with error: %d\r\n",
-                      p_evt->event_data.registered.packet.topic.topic_id,
+                      topic_id,
                       err_code);
         //TODO think about handling such error
         // -> give up and try to register next one
@@ -711,23 +1171,51 @@ static void sched_subscribed_service(void * p_event_data, uint16_t event_size)
     else
     {
         NRF_LOG_INFO("Service: function with ID:%d successfully added.\r\n",
-                     p_evt->event_data.registered.packet.topic.topic_id);
+                     topic_id);
     }
 
+    if (m_self_services_ready)
+    {
+        // next group which lost its topic ID (if any)
+        ext_services_continue();
+        comm_sleep_activity();
+        return;
+    }
+
+    // the slot is free now - push next self service to the creation window
     err_code = create_self_services_continue();
 
     if (SERVICE_ALL_REGISTERED_FLAG == err_code)
     {
-        NRF_LOG_INFO("Service: all self functions has been added.\r\n",
-                     p_evt->event_data.registered.packet.topic.topic_id);
+        self_services_ready();
+    }
+    else if (err_code)
+    {
+        NRF_LOG_ERROR("Service: creator continue error: %d\r\n", err_code);
     }
 }
 
 
-static void sched_timeout_handler(void * p_event_data, uint16_t event_size)
+static void sched_unsubscribed_service(mqttsn_event_t * p_evt)
 {
-    mqttsn_event_t * p_evt = (mqttsn_event_t *) p_event_data;
+    // only the groups are unsubscribed
+    int8_t err_code = comm_manager_inflight_resolve(p_evt);
 
+    if (err_code)
+    {
+        NRF_LOG_ERROR("Service: UNSUBACK handling error: %d\r\n", err_code);
+    }
+
+    // next group left by all endpoints or lost its topic ID (if any)
+    if (m_self_services_ready)
+        ext_services_continue();
+
+    comm_sleep_activity();
+}
+
+
+static void sched_timeout_handler(mqttsn_event_t * p_evt)
+{
     switch(p_evt->event_data.error.error)
     {
         case MQTTSN_ERROR_REJECTED_CONGESTION:
@@ -746,30 +1234,43 @@ static void sched_timeout_handler(void * p_event_data, uint16_t event_size)
     {
         case MQTTSN_PACKET_CONNACK:
             NRF_LOG_ERROR("CONNACK message has not been received!");
+
+            err_code = (int8_t) app_sched_event_put(NULL,
+                                                    0,
+                                                    sched_gateway_failover);
         break;
 
         case MQTTSN_PACKET_REGACK:
             NRF_LOG_ERROR("REGACK message has not been received!");
 
-            err_code = service_retry_register(p_evt->event_data.error.msg_id);
+            err_code = comm_manager_inflight_resolve(p_evt);
         break;
 
         case MQTTSN_PACKET_PUBACK:
             NRF_LOG_ERROR("PUBACK message has not been received!");
+
+            err_code = comm_manager_inflight_resolve(p_evt);
         break;
 
         case MQTTSN_PACKET_SUBACK:
             NRF_LOG_ERROR("SUBACK message has not been received!");
 
-            err_code = service_retry_subscribe(p_evt->event_data.error.msg_id);
+            err_code = comm_manager_inflight_resolve(p_evt);
         break;
 
         case MQTTSN_PACKET_UNSUBACK:
             NRF_LOG_ERROR("UNSUBACK message has not been received!");
+
+            err_code = comm_manager_inflight_resolve(p_evt);
         break;
 
         case MQTTSN_PACKET_PINGREQ:
             NRF_LOG_ERROR("PINGREQ message has not been received!");
+
+            // gateway lost - switch to the next known one
+            err_code = (int8_t) app_sched_event_put(NULL,
+                                                    0,
+                                                    sched_gateway_failover);
         break;
 
         case MQTTSN_PACKET_WILLTOPICUPD:
@@ -783,6 +1284,14 @@ static void sched_timeout_handler(void * p_event_data, uint16_t event_size)
         default:
         case MQTTSN_PACKET_INCORRECT:
             NRF_LOG_ERROR("Unknown error!");
+
+            // DISCONNECT not acknowledged - the session is closed locally
+            if (m_failover_pending)
+            {
+                err_code = (int8_t) app_sched_event_put(NULL,
+                                                        0,
+                                                        sched_gateway_failover);
+            }
         break;
     } // end of switch (msg_type)
 
@@ -791,38 +1300,62 @@ static void sched_timeout_handler(void * p_event_data, uint16_t event_size)
 
     if (SERVICE_RETRY_CNT_MAX_FLAG == err_code)
     {
-        // TODO this should be reconsidered!
-        comm_manager_disconnect_from_gateway();
-        comm_manager_search_gateway();
+        // the gateway does not answer - try the next known one once the
+        // old session is closed (DISCONNECT permit or timeout)
+        m_failover_pending = true;
+
+        if (CONN_MGR_SUCCESS != comm_manager_disconnect_from_gateway())
+        {
+            sched_gateway_failover(NULL, 0);
+        }
     }
 }
 
-static void sched_receive_msg_handler(void * p_event_data, uint16_t event_size)
+static void sched_receive_msg_handler(mqttsn_event_t * p_evt)
 {
-    mqttsn_event_t * p_evt = (mqttsn_event_t *) p_event_data;
-    service_data_t * p_service = NULL;
+    // the gateway flushes the buffered messages after the wake up
+    comm_sleep_activity();
 
-    if (p_evt->event_data.registered.packet.topic.topic_id
-                                                    > SERVICE_SELF_TOPIC_ID_MAX)
-    {
-        //TODO add ext_sub_topic_t handling!
-    }
-    else
-    {
-        p_service = service_pop_with_topic_id(
-                            p_evt->event_data.published.packet.topic.topic_id);
-    }
+    uint16_t topic_id = p_evt->event_data.published.packet.topic.topic_id;
+
+    // '<id>/#' brings back the own config/list pages
+    if (service_config_is_list_topic(topic_id))
+        return;
+
+    const dispatch_entry_t * p_entry = service_dispatch_find(topic_id);
 
-    if (NULL == p_service)
+    if (NULL == p_entry)
     {
-        NRF_LOG_ERROR("Service: no such service (topic) with ID %d",
-                      p_evt->event_data.published.packet.topic.topic_id);
+        NRF_LOG_ERROR("Service: no such service (topic) with ID %d", topic_id);
        return;
     }
 
+    // ... and the own switch states (the topics are published only)
+    if (   dispatch_self == p_entry->kind
+        && false == service_is_inbound(p_entry->self.endpoint,
+                                       p_entry->self.type))
+        return;
+
     int8_t err_code = -1;
 
-    switch (p_service->type)
+    if (dispatch_ext == p_entry->kind)
+    {
+        // the one and only service type of the groups - all members at once
+        err_code = onoff_receive(
+                        service_config_ext_endpoints_get(p_entry->ext_index),
+                        p_evt->event_data.published.packet.p_data,
+                        p_evt->event_data.published.packet.len);
+
+        if (err_code)
+        {
+            NRF_LOG_ERROR("Service: group %d onoff returned with error %d",
+                          p_entry->ext_index,
+                          err_code);
+        }
+        return;
+    }
+
+    switch (p_entry->self.type)
     {
         // not all types are handled
         case info:
@@ -830,21 +1363,27 @@ static void sched_receive_msg_handler(void * p_event_data, uint16_t event_size)
         break;
 
         case onoff:
-            //parse msg AND handle ext subscription
+            err_code = onoff_receive(1 << p_entry->self.endpoint,
+                                    p_evt->event_data.published.packet.p_data,
+                                    p_evt->event_data.published.packet.len);
         break;
 
         case config_sub:
-            err_code = service_config_subscribe(p_service->endpoint,
+            err_code = service_config_subscribe(p_entry->self.endpoint,
                                     p_evt->event_data.published.packet.p_data,
                                     p_evt->event_data.published.packet.len);
         break;
 
         case config_unsub:
-
+            err_code = service_config_unsubscribe(p_entry->self.endpoint,
+                                    p_evt->event_data.published.packet.p_data,
+                                    p_evt->event_data.published.packet.len);
         break;
 
         case config_list:
-
+            err_code = service_config_list(p_entry->self.endpoint,
+                                    p_evt->event_data.published.packet.p_data,
+                                    p_evt->event_data.published.packet.len);
         break;
 
         case type_none:
@@ -856,7 +1395,7 @@ static void sched_receive_msg_handler(void * p_event_data, uint16_t event_size)
     if (err_code)
     {
         NRF_LOG_ERROR("Receiving handler of service %d returned with error %d",
-        p_service->type,
+        p_entry->self.type,
         err_code);
     }
 
@@ -873,6 +1412,7 @@ int main(int argc, char *argv[])
     timer_init();
     leds_init();
     buttons_bsp_init();
+    storage_init();
 
 /*
  *  mash_id_gen();
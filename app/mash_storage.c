@@ -0,0 +1,197 @@
+/*
+ * mash_storage.c
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: MSc Patryk Silkowski
+ */
+
+#include "mash_storage.h"
+
+/* GCC */
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+
+/* SDK */
+#include "crc16.h"
+#include "nrf_fstorage.h"
+#include "nrf_fstorage_nvmc.h"
+#include "nrf_log.h"
+
+
+/*
+ * The pages are placed right below the OpenThread settings area at the end of
+ * the flash. Keep in sync with openthread_nrf52840.ld
+ */
+#define MASH_STORAGE_PAGE_SIZE      0x1000
+#define MASH_STORAGE_START_ADDR     0xF8000
+#define MASH_STORAGE_END_ADDR       (  MASH_STORAGE_START_ADDR                 \
+                                     + storage_none * MASH_STORAGE_PAGE_SIZE - 1)
+
+#define MASH_STORAGE_MAGIC          0xA55A
+
+
+typedef struct {
+    uint16_t magic;
+    uint16_t length;
+    uint16_t crc;
+    uint16_t reserved;
+} record_header_t;
+
+// the flash is written with words, so the buffer has to be word aligned
+typedef struct {
+    record_header_t header;
+    uint8_t         data[MASH_STORAGE_RECORD_SIZE_MAX];
+} __attribute__((aligned(4))) record_buffer_t;
+
+
+static void fstorage_evt_handler(nrf_fstorage_evt_t * p_evt);
+
+NRF_FSTORAGE_DEF(nrf_fstorage_t m_fstorage) =
+{
+    .evt_handler = fstorage_evt_handler,
+    .start_addr  = MASH_STORAGE_START_ADDR,
+    .end_addr    = MASH_STORAGE_END_ADDR,
+};
+
+static record_buffer_t m_write_buf[storage_none];
+static bool            m_write_busy[storage_none];
+
+static bool            m_is_initialized = false;
+
+
+static uint32_t record_addr(mash_storage_record_t record)
+{
+    return MASH_STORAGE_START_ADDR + (uint32_t) record * MASH_STORAGE_PAGE_SIZE;
+}
+
+
+static void fstorage_evt_handler(nrf_fstorage_evt_t * p_evt)
+{
+    mash_storage_record_t record = (mash_storage_record_t) (uintptr_t) p_evt->p_param;
+
+    if (p_evt->result != NRF_SUCCESS)
+    {
+        NRF_LOG_ERROR("Storage: flash operation %d on record %d failed: 0x%x\r\n",
+                      p_evt->id, record, p_evt->result);
+    }
+
+    // the write is always queued right after the erase of the page
+    if (   NRF_FSTORAGE_EVT_WRITE_RESULT == p_evt->id
+        && record < storage_none)
+    {
+        m_write_busy[record] = false;
+    }
+}
+
+
+int8_t mash_storage_init(void)
+{
+    ret_code_t err_code = nrf_fstorage_init(&m_fstorage,
+                                            &nrf_fstorage_nvmc,
+                                            NULL);
+    if (err_code != NRF_SUCCESS)
+    {
+        NRF_LOG_ERROR("Storage: init error: 0x%x\r\n", err_code);
+        return -1;
+    }
+
+    m_is_initialized = true;
+    return MASH_STORAGE_SUCCESS;
+}
+
+
+int8_t mash_storage_read(mash_storage_record_t record,
+                         void * p_data,
+                         uint16_t * p_length)
+{
+    if (false == m_is_initialized)
+        return -1;
+
+    if (   record >= storage_none
+        || NULL == p_data
+        || NULL == p_length)
+        return -2;
+
+    record_header_t header;
+    uint32_t        addr = record_addr(record);
+
+    if (NRF_SUCCESS != nrf_fstorage_read(&m_fstorage,
+                                         addr,
+                                         &header,
+                                         sizeof(record_header_t)))
+        return -3;
+
+    // erased page reads as 0xFF
+    if (   MASH_STORAGE_MAGIC != header.magic
+        || header.length > *p_length)
+        return -4;
+
+    if (NRF_SUCCESS != nrf_fstorage_read(&m_fstorage,
+                                         addr + sizeof(record_header_t),
+                                         p_data,
+                                         header.length))
+        return -3;
+
+    if (header.crc != crc16_compute(p_data, header.length, NULL))
+        return -5;
+
+    *p_length = header.length;
+    return MASH_STORAGE_SUCCESS;
+}
+
+
+int8_t mash_storage_write(mash_storage_record_t record,
+                          void const * p_data,
+                          uint16_t length)
+{
+    if (false == m_is_initialized)
+        return -1;
+
+    if (   record >= storage_none
+        || NULL == p_data
+        || length > MASH_STORAGE_RECORD_SIZE_MAX)
+        return -2;
+
+    // the previous write of this record is not finished yet
+    if (m_write_busy[record])
+        return -6;
+
+    record_buffer_t * p_buf = &m_write_buf[record];
+
+    memset(p_buf, 0xFF, sizeof(record_buffer_t));
+    memcpy(p_buf->data, p_data, length);
+
+    p_buf->header.magic  = MASH_STORAGE_MAGIC;
+    p_buf->header.length = length;
+    p_buf->header.crc    = crc16_compute(p_buf->data, length, NULL);
+
+    // round up to the whole words
+    uint32_t write_len = (sizeof(record_header_t) + length + 3) & ~3UL;
+    uint32_t addr      = record_addr(record);
+
+    m_write_busy[record] = true;
+
+    ret_code_t err_code = nrf_fstorage_erase(&m_fstorage,
+                                             addr,
+                                             1,
+                                             (void *) (uintptr_t) record);
+    if (err_code == NRF_SUCCESS)
+    {
+        err_code = nrf_fstorage_write(&m_fstorage,
+                                      addr,
+                                      p_buf,
+                                      write_len,
+                                      (void *) (uintptr_t) record);
+    }
+
+    if (err_code != NRF_SUCCESS)
+    {
+        NRF_LOG_ERROR("Storage: write of record %d error: 0x%x\r\n",
+                      record, err_code);
+        m_write_busy[record] = false;
+        return -3;
+    }
+
+    return MASH_STORAGE_SUCCESS;
+}
@@ -0,0 +1,54 @@
+/*
+ * mash_storage.h
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: MSc Patryk Silkowski
+ */
+
+#ifndef APP_MASH_STORAGE_H_
+#define APP_MASH_STORAGE_H_
+
+/* GCC */
+#include <stdint.h>
+
+
+#define MASH_STORAGE_SUCCESS              0
+#define MASH_STORAGE_RECORD_SIZE_MAX      256       /**< Max payload of a single record [B]. */
+
+
+/*
+ * Each record lives in its own flash page
+ */
+typedef enum {
+    storage_topic_cache = 0,
+    storage_gateway,
+    storage_none
+} mash_storage_record_t;
+
+
+/**@brief Function for initializing the flash storage (NVMC backend).
+ */
+int8_t mash_storage_init(void);
+
+/**@brief Function for reading the record from the flash.
+ *
+ * @param[out]   p_data    Buffer for the record payload.
+ * @param[inout] p_length  Size of the buffer, on success the length of the payload.
+ *
+ * @details Returns negative value if the record is empty or corrupted.
+ */
+int8_t mash_storage_read(mash_storage_record_t record,
+                         void * p_data,
+                         uint16_t * p_length);
+
+/**@brief Function for writing the record to the flash.
+ *
+ * @details The payload is copied, so the buffer might be released right after
+ * the call. The page is erased and written in the background.
+ */
+int8_t mash_storage_write(mash_storage_record_t record,
+                          void const * p_data,
+                          uint16_t length);
+
+
+#endif /* APP_MASH_STORAGE_H_ */
@@ -13,55 +13,191 @@
 #include <string.h>
 #include <stdio.h>
 
+/* SDK */
+#include "app_util.h"
+
+/* APP */
+#include "comm_manager.h"
+#include "comm_utils.h"
+#include "service_dispatch.h"
+
 
 #define EXT_ENDPOINT_LENGTH             14
-#define EXT_TOPIC_LIMIT                 20
+
+// decoded base64 ID of the ext device
+#define EXT_ID_SIZE                     (BASE64_LENGTH / 4 * 3)
+
+#define EXT_ENDPOINT_NUMBER_MASK        0x0F
+#define EXT_ENDPOINT_PAD_POS            4
+
+// the group index has to fit in uint8_t (dispatch table, sub lists)
+#ifndef EXT_TOPIC_LIMIT
+#define EXT_TOPIC_LIMIT                 32
+#endif
 
 // e.i. how many subs can get each endpoint
 #define EXT_SUB_LIMIT_PER_ENDPOINT      8
 
+#define EXT_TOPIC_NEW                   (-1)
+
+// groups left by all self endpoints, waiting for the UNSUBSCRIBE
+#define EXT_UNSUB_QUEUE_SIZE            4
+
+/*
+ * config/list response - "<endpoint>;<cursor>;<next>;<name>,<name>..."
+ * next is the cursor of the following page or 0 after the last one
+ */
+#define CONFIG_LIST_PAGE_SIZE           COMM_PUBLISH_STREAM_MAX
+
+// pages streamed per request, the controller continues with the next cursor
+#define CONFIG_LIST_PAGES_MAX           4
+
+#define CONFIG_LIST_HEADER_MAX          sizeof("9;255;255;")
+#define CONFIG_LIST_NAMES_PER_PAGE                                            \
+        ((CONFIG_LIST_PAGE_SIZE - CONFIG_LIST_HEADER_MAX + 1)                 \
+                                                / (EXT_ENDPOINT_LENGTH + 1))
+
+// "<id>/config/list", published by the device (self ones are subscribed)
+#define CONFIG_LIST_TOPIC_LENGTH        (BASE64_LENGTH + sizeof("/" SERVICE_STR_CONFIG_LIST))
+
+// power of two, at least twice the EXT_TOPIC_LIMIT (load factor <= 0.5)
+#ifndef EXT_NAME_INDEX_SIZE
+#define EXT_NAME_INDEX_SIZE             64
+#endif
+
+#define EXT_NAME_INDEX_MASK             (EXT_NAME_INDEX_SIZE - 1)
+#define EXT_NAME_INDEX_EMPTY            0xFF
+
+STATIC_ASSERT(EXT_TOPIC_LIMIT < EXT_NAME_INDEX_EMPTY);
+STATIC_ASSERT(SERVICE_SELF_TOPIC_ID_MAX + EXT_TOPIC_LIMIT < SERVICE_DISPATCH_TABLE_SIZE);
+STATIC_ASSERT(EXT_NAME_INDEX_SIZE >= 2 * EXT_TOPIC_LIMIT);
+STATIC_ASSERT(0 == (EXT_NAME_INDEX_SIZE & EXT_NAME_INDEX_MASK));
+
+STATIC_ASSERT(SERVICE_BSP_ENDPOINTS <= 8 * sizeof(endpoint_mask_t));
+STATIC_ASSERT(SERVICE_ENDPOINT_MAX <= EXT_ENDPOINT_NUMBER_MASK);
+STATIC_ASSERT(CONFIG_LIST_NAMES_PER_PAGE >= 1);
+
+
+/*
+ * Packed ext endpoint name (s4t0dOpl8i2f/0) - compared with memcmp
+ * The base64 padding ('=') is kept to restore the name of the topic
+ */
+typedef struct {
+    uint8_t id[EXT_ID_SIZE];    // decoded ID, zeros after the padding
+    uint8_t endpoint;           // endpoint number | padding << EXT_ENDPOINT_PAD_POS
+} ext_endpoint_t;
+
+STATIC_ASSERT(sizeof(ext_endpoint_t) == EXT_ID_SIZE + 1);
 
 // External subscribed topics type - so called 'group' container
 typedef struct {
-    char ext_endpoint_name[EXT_ENDPOINT_LENGTH + 1];  // +1 for '/0'
+    ext_endpoint_t ext_endpoint;
     uint16_t topic_id;
-    endpoint_t endpoints[SERVICE_BSP_ENDPOINTS];
-    uint8_t endpoints_cnt;  // assumed as a counter and an index of the next one
+    endpoint_mask_t endpoints;  // members of the group, bit per self endpoint
 } ext_sub_topic_t;
 
-// The subscription list type for each endpoint
+// The subscription list type for each endpoint (indexes of m_ext_topics)
 typedef struct {
-    char ext_endpoint_list [EXT_SUB_LIMIT_PER_ENDPOINT][EXT_ENDPOINT_LENGTH + 1];
+    uint8_t ext_index[EXT_SUB_LIMIT_PER_ENDPOINT];
     uint8_t sub_counter;
 } ext_sub_list_t;
 
 
 /* Structure containing temporary subscription info
  * Will receive the original topic ID within the SUBACK event
- *
- * msg_id acts as a link between event <=> service_setup <=> service-config
+ * (routed by comm_manager to ext_subscribed_handler)
  */
 static struct {
-    char ext_endpoint_name[EXT_ENDPOINT_LENGTH + 1];  // +1 for '/0'
-    uint16_t msg_id;
+    ext_endpoint_t ext_endpoint;
+    bool is_pending;
+    int16_t ext_index;      // re-subscribed ext topic or EXT_TOPIC_NEW
     endpoint_t self_endpoint;
 } m_ext_sub_temp_s;
 
 static ext_sub_topic_t m_ext_topics[EXT_TOPIC_LIMIT];
 static uint8_t  m_ext_topics_cnt;
 
+/*
+ * Ext endpoint name -> index of m_ext_topics (open addressing, linear
+ * probing). The topic ID -> index is kept by service_dispatch
+ */
+static uint8_t m_name_index[EXT_NAME_INDEX_SIZE];
+
 static ext_sub_list_t m_sub_list_arr[SERVICE_BSP_ENDPOINTS];
 
+/*
+ * The group is removed as soon as the last self endpoint leaves it, the
+ * UNSUBSCRIBE is sent from the queue when the creation slot is available
+ * (the head of the queue is in flight if m_unsub_is_pending)
+ */
+static ext_endpoint_t m_unsub_queue[EXT_UNSUB_QUEUE_SIZE];
+static uint8_t m_unsub_cnt;
+static bool m_unsub_is_pending;
+
+/*
+ * config/list stream - one page in flight, the next one is built from
+ * the subscription list when the PUBACK comes
+ */
+static struct {
+    uint16_t topic_id;      // response topic, registered with the first request
+    uint16_t msg_id;        // REGISTER of the topic
+    bool is_busy;
+    endpoint_t endpoint;
+    uint8_t cursor;         // index of the first name on the page
+    uint8_t pages;
+} m_list_stream;
+
 static bool m_is_initialized = false;
 
 
-int8_t add_sub_to_endpoints_sub_list(endpoint_t endp,
-                                     uint8_t * p_msg,
-                                     uint16_t msg_length)
+static int8_t ext_subscribed_handler(uint16_t topic_id, bool is_acked);
+static int8_t ext_unsubscribed_handler(uint16_t topic_id, bool is_acked);
+
+
+/*
+ * FNV-1a over the packed name
+ */
+static uint16_t name_hash(const ext_endpoint_t * p_ext_endpoint)
+{
+    const uint8_t * p_byte = (const uint8_t *) p_ext_endpoint;
+    uint32_t hash = 2166136261U;
+
+    for (uint8_t i = 0; i < sizeof(ext_endpoint_t); i++)
+    {
+        hash ^= p_byte[i];
+        hash *= 16777619U;
+    }
+
+    return (uint16_t) ((hash ^ (hash >> 16)) & EXT_NAME_INDEX_MASK);
+}
+
+
+static void name_index_add(uint8_t ext_index)
+{
+    uint16_t idx = name_hash(&m_ext_topics[ext_index].ext_endpoint);
+
+    // never full - the size is at least twice the limit
+    while (EXT_NAME_INDEX_EMPTY != m_name_index[idx])
+        idx = (idx + 1) & EXT_NAME_INDEX_MASK;
+
+    m_name_index[idx] = ext_index;
+}
+
+
+/*
+ * Linear probing leaves no tombstones - the index is rebuilt after removal
+ */
+static void name_index_rebuild(void)
 {
-    if (EXT_ENDPOINT_LENGTH != msg_length)
-        return -10;
+    memset(m_name_index, EXT_NAME_INDEX_EMPTY, sizeof(m_name_index));
 
+    for (uint8_t i = 0; i < m_ext_topics_cnt; i++)
+        name_index_add(i);
+}
+
+
+int8_t add_sub_to_endpoints_sub_list(endpoint_t endp, uint8_t ext_index)
+{
     uint8_t cnt = m_sub_list_arr[endp].sub_counter;
 
     if (cnt >= EXT_SUB_LIMIT_PER_ENDPOINT)
@@ -70,59 +206,80 @@ int8_t add_sub_to_endpoints_sub_list(endpoint_t endp,
     // check if already exists
     for (uint8_t i = 0; i < cnt; i++)
     {
-        if (0 == strcmp((char*) p_msg,
-                        m_sub_list_arr[endp].ext_endpoint_list[i]))
-        {
+        if (ext_index == m_sub_list_arr[endp].ext_index[i])
             return -12;
-        }
     }
 
-    // write the ext endpoint name to the list
-    int8_t err_code;
-    err_code = (int8_t) snprintf(m_sub_list_arr[endp].ext_endpoint_list[cnt],
-                                 msg_length + 1,
-                                 "%s",
-                                 p_msg);
-
-    if (err_code < 0)
-        return -13;
-
+    m_sub_list_arr[endp].ext_index[cnt] = ext_index;
     m_sub_list_arr[endp].sub_counter++;
     return 0;
 }
 
 
+/*
+ * Removes the group from the list (to_index == EXT_NAME_INDEX_EMPTY) or
+ * changes its index (the group was moved)
+ */
+static int8_t sub_list_update(endpoint_t endp,
+                              uint8_t ext_index,
+                              uint8_t to_index)
+{
+    ext_sub_list_t * p_list = &m_sub_list_arr[endp];
+
+    for (uint8_t i = 0; i < p_list->sub_counter; i++)
+    {
+        if (ext_index != p_list->ext_index[i])
+            continue;
+
+        if (EXT_NAME_INDEX_EMPTY != to_index)
+        {
+            p_list->ext_index[i] = to_index;
+            return 0;
+        }
+
+        // keep the order of the subscriptions (config_list)
+        p_list->sub_counter--;
+        memmove(&p_list->ext_index[i],
+                &p_list->ext_index[i + 1],
+                p_list->sub_counter - i);
+        return 0;
+    }
+
+    return -1;
+}
+
+
 int8_t add_subscribed_ext_topic(uint16_t topic_id)
 {
-    uint8_t temp_cnt = m_ext_topics[m_ext_topics_cnt].endpoints_cnt;
-    if (temp_cnt)      //endpoint counter of fresh topic should be zero!
+    if (m_ext_topics_cnt >= EXT_TOPIC_LIMIT)
+        return -3;
+
+    if (m_ext_topics[m_ext_topics_cnt].endpoints)   // fresh topic has no members!
         return -1;
 
-    m_ext_topics[m_ext_topics_cnt].topic_id = topic_id;
+    // the group which never receives anything is not added at all
+    if (service_dispatch_add_ext(topic_id, m_ext_topics_cnt))
+        return -4;
 
-    //add first endpoint of a new topic
-    m_ext_topics[m_ext_topics_cnt].endpoints[temp_cnt]
-                                             = m_ext_sub_temp_s.self_endpoint;
+    m_ext_topics[m_ext_topics_cnt].topic_id = topic_id;
+    m_ext_topics[m_ext_topics_cnt].ext_endpoint = m_ext_sub_temp_s.ext_endpoint;
 
-    int8_t err_code = snprintf(m_ext_topics[m_ext_topics_cnt].ext_endpoint_name,
-                               EXT_ENDPOINT_LENGTH + 1,
-                               "%s",
-                               m_ext_sub_temp_s.ext_endpoint_name);
+    name_index_add(m_ext_topics_cnt);
 
-    if (err_code < 0)
-    {
-        return -2;
-    }
-    else
-    {
-        m_ext_topics[m_ext_topics_cnt].endpoints_cnt++;
-        m_ext_topics_cnt++;
-        return 0;
-    }
+    //add first endpoint of a new topic
+    m_ext_topics[m_ext_topics_cnt].endpoints
+                                = 1 << m_ext_sub_temp_s.self_endpoint;
+    m_ext_topics_cnt++;
+    return 0;
 }
 
 
-bool is_ext_endpoint_name_valid(char * name, uint16_t * length)
+/*
+ * Validates the name and packs it into p_ext_endpoint
+ */
+bool is_ext_endpoint_name_valid(char * name,
+                                uint16_t * length,
+                                ext_endpoint_t * p_ext_endpoint)
 {
     /*
      * Valid pattern --> example: s4t0dOpl8i2f/0
@@ -132,26 +289,46 @@ bool is_ext_endpoint_name_valid(char * name, uint16_t * length)
     if (EXT_ENDPOINT_LENGTH != *length)
         return false;
 
-    if ('/' != name[12])
+    if ('/' != name[BASE64_LENGTH])
         return false;
 
-    if (   name[13] - '0' < 10
-        && name[13] - '0' >= 0)
-        return true;
+    uint8_t number = name[BASE64_LENGTH + 1] - '0';
 
-    return false;
+    if (number > SERVICE_ENDPOINT_MAX)
+        return false;
+
+    memset(p_ext_endpoint, 0, sizeof(ext_endpoint_t));
+
+    // base64 charset, the padding at the end only
+    size_t id_size;
+    if (mbedtls_base64_decode(p_ext_endpoint->id,
+                              EXT_ID_SIZE,
+                              &id_size,
+                              (const unsigned char *) name,
+                              BASE64_LENGTH))
+        return false;
+
+    p_ext_endpoint->endpoint = number
+                             | (EXT_ID_SIZE - id_size) << EXT_ENDPOINT_PAD_POS;
+    return true;
 }
 
 
-ext_sub_topic_t * is_ext_topic_subscribed(char * topic_name)
+ext_sub_topic_t * is_ext_topic_subscribed(const ext_endpoint_t * p_ext_endpoint)
 {
-    if (0 == m_ext_topics_cnt)
-        return NULL;
+    uint16_t idx = name_hash(p_ext_endpoint);
 
-    for (uint8_t i = 0; i < m_ext_topics_cnt; i++)
+    // the probing stops on the first empty entry
+    while (EXT_NAME_INDEX_EMPTY != m_name_index[idx])
     {
-        if (0 == strcmp(topic_name, m_ext_topics[i].ext_endpoint_name))
-            return &m_ext_topics[i];
+        ext_sub_topic_t * p_ext_topic = &m_ext_topics[m_name_index[idx]];
+
+        if (0 == memcmp(p_ext_endpoint,
+                        &p_ext_topic->ext_endpoint,
+                        sizeof(ext_endpoint_t)))
+            return p_ext_topic;
+
+        idx = (idx + 1) & EXT_NAME_INDEX_MASK;
     }
 
     return NULL;
@@ -162,31 +339,206 @@ int8_t add_endpoint_to_subscribed_ext_topic(endpoint_t endpoint,
                                             ext_sub_topic_t * p_ext_topic)
 {
     // check if the endpoint is already set to the ext topic
-    for (uint8_t i = 0; i < p_ext_topic->endpoints_cnt; i++)
+    if (p_ext_topic->endpoints & (1 << endpoint))
+        return -1;
+
+    p_ext_topic->endpoints |= 1 << endpoint;
+
+    return 0;
+}
+
+
+/*
+ * Drops the group without members - the last one takes its place, so the
+ * groups stay packed at the beginning of m_ext_topics
+ */
+static void ext_topic_remove(uint8_t ext_index)
+{
+    uint8_t last = m_ext_topics_cnt - 1;
+
+    if (m_ext_topics[ext_index].topic_id)
+        service_dispatch_remove(m_ext_topics[ext_index].topic_id);
+
+    if (ext_index != last)
     {
-        if (p_ext_topic->endpoints[i] == endpoint)
-            return -1;
+        m_ext_topics[ext_index] = m_ext_topics[last];
+
+        // not dispatched - subscribed once again (service_config_continue)
+        if (   m_ext_topics[ext_index].topic_id
+            && service_dispatch_add_ext(m_ext_topics[ext_index].topic_id,
+                                        ext_index))
+        {
+            service_dispatch_remove(m_ext_topics[ext_index].topic_id);
+            m_ext_topics[ext_index].topic_id = 0;
+        }
+
+        endpoint_mask_t members = m_ext_topics[ext_index].endpoints;
+
+        while (members)
+        {
+            endpoint_t endp = __builtin_ctz(members);
+
+            sub_list_update(endp, last, ext_index);
+            members &= members - 1;
+        }
+    }
+
+    memset(&m_ext_topics[last], 0, sizeof(ext_sub_topic_t));
+    m_ext_topics_cnt--;
+
+    name_index_rebuild();
+}
+
+
+static int8_t unsub_queue_find(const ext_endpoint_t * p_ext_endpoint)
+{
+    for (uint8_t i = 0; i < m_unsub_cnt; i++)
+    {
+        if (0 == memcmp(p_ext_endpoint,
+                        &m_unsub_queue[i],
+                        sizeof(ext_endpoint_t)))
+            return (int8_t) i;
     }
 
-    p_ext_topic->endpoints[p_ext_topic->endpoints_cnt] = endpoint;
-    p_ext_topic->endpoints_cnt++;
+    return -1;
+}
+
+
+static void unsub_queue_remove(uint8_t idx)
+{
+    m_unsub_cnt--;
+    memmove(&m_unsub_queue[idx],
+            &m_unsub_queue[idx + 1],
+            (m_unsub_cnt - idx) * sizeof(ext_endpoint_t));
+}
+
+
+/*
+ * Takes the creation slot with the full topic name of the ext endpoint
+ * Returns the slot or negative error code (SERVICE_BUSY_FLAG)
+ */
+static int8_t ext_topic_slot_create(const ext_endpoint_t * p_ext_endpoint)
+{
+    char ext_base64[BASE64_LENGTH + 1];
+    int8_t ext_endpoint = p_ext_endpoint->endpoint & EXT_ENDPOINT_NUMBER_MASK;
+    uint8_t padding = p_ext_endpoint->endpoint >> EXT_ENDPOINT_PAD_POS;
 
+    // the one and only service type which is handled by this device
+    service_type_t type = onoff;
+
+    size_t base64_length;
+    int8_t err_code = (int8_t) mbedtls_base64_encode(
+                                        (unsigned char *) ext_base64,
+                                        BASE64_LENGTH + 1,
+                                        &base64_length,
+                                        p_ext_endpoint->id,
+                                        EXT_ID_SIZE - padding);
+
+    if (err_code)
+        return -4;
+
+    return service_create(ext_base64, ext_endpoint, type);
+}
+
+
+/*
+ * Builds a full topic name of the ext endpoint and subscribes to that one
+ * ext_index points the ext topic being re-subscribed or EXT_TOPIC_NEW
+ */
+static int8_t ext_topic_subscribe(const ext_endpoint_t * p_ext_endpoint,
+                                  endpoint_t self_endpoint,
+                                  int16_t ext_index)
+{
+    int8_t err_code;
+    int8_t slot = ext_topic_slot_create(p_ext_endpoint);
+
+    if (slot < 0)
+        return -5;
+
+    // save temp data before the SUBACK has a chance to arrive
+    m_ext_sub_temp_s.self_endpoint = self_endpoint;
+    m_ext_sub_temp_s.ext_index = ext_index;
+    m_ext_sub_temp_s.ext_endpoint = *p_ext_endpoint;
+
+    err_code = service_subscribe((uint8_t) slot, ext_subscribed_handler);
+
+    if (err_code)
+    {
+        service_destroy((uint8_t) slot);
+        return -7;
+    }
+
+    m_ext_sub_temp_s.is_pending = true;
     return 0;
 }
 
 
+static bool is_ext_sub_pending(void)
+{
+    return m_ext_sub_temp_s.is_pending;
+}
+
+
 /*
- * Set the initial values on the external topics array
+ * Sends the UNSUBSCRIBE of the head of the queue
  */
-void service_config_init(void)
+static int8_t ext_unsub_continue(void)
 {
-    for (int i = 0; i < EXT_TOPIC_LIMIT; i++)
+    if (   m_unsub_is_pending
+        || 0 == m_unsub_cnt)
+        return 0;
+
+    int8_t slot = ext_topic_slot_create(&m_unsub_queue[0]);
+
+    if (SERVICE_BUSY_FLAG == slot)
+        return 0;   // window is full, wait for the acknowledgements
+
+    if (slot < 0)
+        return -5;
+
+    int8_t err_code = service_unsubscribe((uint8_t) slot,
+                                          ext_unsubscribed_handler);
+
+    if (err_code)
     {
-        memset(m_ext_topics[i].endpoints,
-               SERVICE_BSP_ENDPOINTS,
-               sizeof(endpoint_t) * SERVICE_BSP_ENDPOINTS);
+        // not connected - sent after the reconnection (service_config_continue)
+        service_destroy((uint8_t) slot);
+        return -7;
     }
 
+    m_unsub_is_pending = true;
+    return 0;
+}
+
+
+/*
+ * UNSUBACK of the queue head (the creation slot is already released)
+ */
+static int8_t ext_unsubscribed_handler(uint16_t topic_id, bool is_acked)
+{
+    if (false == m_unsub_is_pending)
+        return -4;
+
+    m_unsub_is_pending = false;
+
+    // the head stays - sent after the reconnection (service_config_continue)
+    if (false == is_acked)
+        return -5;
+
+    unsub_queue_remove(0);
+
+    return ext_unsub_continue();
+}
+
+
+/*
+ * Set the initial values on the external topics array
+ */
+void service_config_init(void)
+{
+    memset(m_ext_topics, 0, sizeof(m_ext_topics));
+    memset(m_name_index, EXT_NAME_INDEX_EMPTY, sizeof(m_name_index));
+
     m_is_initialized = true;
 }
 
@@ -203,88 +555,146 @@ int8_t service_config_subscribe(endpoint_t endpoint,
     if (false == m_is_initialized)
         return -1;
 
+    ext_endpoint_t ext_endpoint;
+
     // check if the name is valid
-    if (false == is_ext_endpoint_name_valid((char*) p_msg, &msg_length))
+    if (false == is_ext_endpoint_name_valid((char*) p_msg,
+                                            &msg_length,
+                                            &ext_endpoint))
         return -2;
 
-    ext_sub_topic_t * p_ext_sub = is_ext_topic_subscribed((char*) p_msg);
+    // one external subscription at a time
+    if (is_ext_sub_pending())
+        return -8;
+
+    ext_sub_topic_t * p_ext_sub = is_ext_topic_subscribed(&ext_endpoint);
 
-    // TODO pack n wrap
     int8_t err_code;
     if (NULL != p_ext_sub)
     {
-        // add self endpoint to existing ext_topic (extend the group)
-        err_code = add_endpoint_to_subscribed_ext_topic(endpoint, p_ext_sub);
-
         // the self endpoint is already engaged with ext topic
-        if (err_code)
+        if (p_ext_sub->endpoints & (1 << endpoint))
             return -3;
 
         // add ext endpoint to subscription list according to config_list
-        err_code = add_sub_to_endpoints_sub_list(endpoint, p_msg, msg_length);
+        // first - the member bit is set only if the list has room for it
+        err_code = add_sub_to_endpoints_sub_list(endpoint,
+                                                 (uint8_t) (p_ext_sub - m_ext_topics));
 
-        return err_code;
+        if (err_code)
+            return err_code;
+
+        // add self endpoint to existing ext_topic (extend the group)
+        return add_endpoint_to_subscribed_ext_topic(endpoint, p_ext_sub);
     }
 
-    // build a full topic name and subscribe to that one
-    char ext_base64[BASE64_LENGTH + 1];
-    int8_t ext_endpoint = p_msg[13] - '0';
+    if (m_ext_topics_cnt >= EXT_TOPIC_LIMIT)
+        return -9;
 
-    // the one and only service type which is handled by this device
-    service_type_t type = onoff;
+    // the SUBACK adds the new group to the list - no SUBSCRIBE without room
+    if (m_sub_list_arr[endpoint].sub_counter >= EXT_SUB_LIMIT_PER_ENDPOINT)
+        return -11;
+
+    // the group was left recently - its UNSUBSCRIBE must not follow this one
+    int8_t unsub_idx = unsub_queue_find(&ext_endpoint);
+
+    if (unsub_idx >= 0)
+    {
+        if (0 == unsub_idx && m_unsub_is_pending)
+            return -8;
+
+        unsub_queue_remove((uint8_t) unsub_idx);
+    }
+
+    return ext_topic_subscribe(&ext_endpoint, endpoint, EXT_TOPIC_NEW);
+}
 
-    err_code = (int8_t) snprintf(ext_base64,
-                                 BASE64_LENGTH + 1,
-                                 "%s",
-                                 (char*) p_msg);
 
-    if (err_code < 0)
+int8_t service_config_unsubscribe(endpoint_t endpoint,
+                                  uint8_t * p_msg,
+                                  uint16_t msg_length)
+{
+    if (false == m_is_initialized)
+        return -1;
+
+    ext_endpoint_t ext_endpoint;
+
+    if (false == is_ext_endpoint_name_valid((char*) p_msg,
+                                            &msg_length,
+                                            &ext_endpoint))
+        return -2;
+
+    // the group indexes have to stay put until the SUBACK
+    if (is_ext_sub_pending())
+        return -8;
+
+    ext_sub_topic_t * p_ext_sub = is_ext_topic_subscribed(&ext_endpoint);
+
+    if (NULL == p_ext_sub)
+        return -3;
+
+    if (0 == (p_ext_sub->endpoints & (1 << endpoint)))
         return -4;
 
-    err_code = service_create(ext_base64, ext_endpoint, type);
+    // the members are the reference count - is it the last one?
+    bool is_last = (p_ext_sub->endpoints == (1 << endpoint));
 
-    if (err_code)
+    // the gateway forgot the group already if it has no topic ID
+    bool is_subscribed = (0 != p_ext_sub->topic_id);
+
+    if (   is_last
+        && is_subscribed
+        && m_unsub_cnt >= EXT_UNSUB_QUEUE_SIZE)
         return -5;
 
-    // save temp data before topic subscription
-    if (service_is_created(&m_ext_sub_temp_s.msg_id))
-    {
-        m_ext_sub_temp_s.self_endpoint = endpoint;
+    uint8_t ext_index = (uint8_t) (p_ext_sub - m_ext_topics);
 
-        err_code = (int8_t) snprintf(m_ext_sub_temp_s.ext_endpoint_name,
-                                     EXT_ENDPOINT_LENGTH + 1,
-                                     "%s",
-                                     (char*) p_msg);
+    // the local binding goes right away
+    p_ext_sub->endpoints &= ~(1 << endpoint);
+    sub_list_update(endpoint, ext_index, EXT_NAME_INDEX_EMPTY);
 
-        if (err_code < 0)
-            return -4;
-    }
-    else
-    {
-        return -6;
-    }
+    if (false == is_last)
+        return 0;
 
-    err_code = service_subscribe();
+    ext_topic_remove(ext_index);
 
-    if (err_code)
-        return -7;
-    else
+    if (false == is_subscribed)
         return 0;
+
+    m_unsub_queue[m_unsub_cnt++] = ext_endpoint;
+
+    return ext_unsub_continue();
 }
 
 
-int8_t service_config_add_ext_topic(uint16_t ret_msg_id, uint16_t topic_id)
+/*
+ * SUBACK of the ext topic (the creation slot is already released)
+ */
+static int8_t ext_subscribed_handler(uint16_t topic_id, bool is_acked)
 {
-    uint16_t msg_id;
-    if (!service_is_created(&msg_id))
-        return -1;
-
     int8_t err_code;
 
     // ITS A MATCH!
-    if (   ret_msg_id == msg_id
-        && ret_msg_id == m_ext_sub_temp_s.msg_id)
+    if (m_ext_sub_temp_s.is_pending)
     {
+        m_ext_sub_temp_s.is_pending = false;
+
+        // the new group is dropped (the controller asks again), the existing
+        // one keeps no topic ID and is subscribed after the reconnection
+        if (false == is_acked)
+            return -5;
+
+        // the group already exists, only its topic ID was lost
+        if (EXT_TOPIC_NEW != m_ext_sub_temp_s.ext_index)
+        {
+            if (service_dispatch_add_ext(topic_id,
+                                         (uint8_t) m_ext_sub_temp_s.ext_index))
+                return -3;
+
+            m_ext_topics[m_ext_sub_temp_s.ext_index].topic_id = topic_id;
+            return 0;
+        }
+
         /*
          * add to the database of external topics
          * (pass the topic ID and first self endpoint)
@@ -292,11 +702,19 @@ int8_t service_config_add_ext_topic(uint16_t ret_msg_id, uint16_t topic_id)
         err_code = add_subscribed_ext_topic(topic_id);
 
         if (err_code)
+        {
+            // roll back - the gateway forgets the group as well
+            if (m_unsub_cnt < EXT_UNSUB_QUEUE_SIZE)
+            {
+                m_unsub_queue[m_unsub_cnt++] = m_ext_sub_temp_s.ext_endpoint;
+                ext_unsub_continue();
+            }
+
             return -2;
+        }
 
         err_code = add_sub_to_endpoints_sub_list(m_ext_sub_temp_s.self_endpoint,
-                         (uint8_t *) m_ext_sub_temp_s.ext_endpoint_name,
-                         strlen((char*) m_ext_sub_temp_s.ext_endpoint_name));
+                                                 m_ext_topics_cnt - 1);
 
         return err_code;
     }
@@ -305,3 +723,244 @@ int8_t service_config_add_ext_topic(uint16_t ret_msg_id, uint16_t topic_id)
         return -4;
     }
 }
+
+
+void service_config_resume(bool is_clean_session)
+{
+    // the pending subscription (if any) is lost with the connection
+    memset(&m_ext_sub_temp_s, 0, sizeof(m_ext_sub_temp_s));
+    m_unsub_is_pending = false;
+    m_list_stream.is_busy = false;
+
+    if (false == is_clean_session)
+        return;     // the gateway keeps the subscriptions of the groups
+
+    // nothing to unsubscribe from, the response topic is not registered
+    m_unsub_cnt = 0;
+    m_list_stream.topic_id = 0;
+
+    service_dispatch_clear(dispatch_ext);
+
+    for (uint8_t i = 0; i < m_ext_topics_cnt; i++)
+    {
+        m_ext_topics[i].topic_id = 0;
+    }
+}
+
+
+int8_t service_config_continue(void)
+{
+    if (   is_ext_sub_pending()
+        || m_unsub_is_pending)
+        return 0;
+
+    // the groups left while disconnected go first
+    if (m_unsub_cnt)
+        return ext_unsub_continue();
+
+    for (uint8_t i = 0; i < m_ext_topics_cnt; i++)
+    {
+        if (0 == m_ext_topics[i].topic_id)
+        {
+            // any member - the group already exists
+            endpoint_t endpoint = __builtin_ctz(m_ext_topics[i].endpoints);
+
+            return ext_topic_subscribe(&m_ext_topics[i].ext_endpoint,
+                                       endpoint,
+                                       (int16_t) i);
+        }
+    }
+
+    return SERVICE_CONFIG_ALL_SUBSCRIBED_FLAG;
+}
+
+
+endpoint_mask_t service_config_ext_endpoints_get(uint8_t ext_index)
+{
+    if (ext_index >= m_ext_topics_cnt)
+        return 0;
+
+    return m_ext_topics[ext_index].endpoints;
+}
+
+
+bool service_config_is_list_topic(uint16_t topic_id)
+{
+    return    0 != topic_id
+           && m_list_stream.topic_id == topic_id;
+}
+
+
+/*
+ * config/list stream
+ */
+
+
+/*
+ * Builds the page right in the buffer of the publish - the names are
+ * restored from the packed ones, no copy of the list is kept
+ */
+static uint16_t list_page_build(char * p_page, uint8_t * p_next)
+{
+    const ext_sub_list_t * p_list = &m_sub_list_arr[m_list_stream.endpoint];
+
+    uint8_t cursor = MIN(m_list_stream.cursor, p_list->sub_counter);
+    uint8_t cnt    = MIN(p_list->sub_counter - cursor,
+                         CONFIG_LIST_NAMES_PER_PAGE);
+
+    *p_next = (cursor + cnt < p_list->sub_counter) ? cursor + cnt : 0;
+
+    uint16_t length = (uint16_t) snprintf(p_page,
+                                          CONFIG_LIST_HEADER_MAX,
+                                          "%d;%d;%d;",
+                                          m_list_stream.endpoint,
+                                          cursor,
+                                          *p_next);
+
+    for (uint8_t i = cursor; i < cursor + cnt; i++)
+    {
+        const ext_endpoint_t * p_ext_endpoint =
+                &m_ext_topics[p_list->ext_index[i]].ext_endpoint;
+        uint8_t padding = p_ext_endpoint->endpoint >> EXT_ENDPOINT_PAD_POS;
+        size_t  base64_length;
+
+        if (i != cursor)
+            p_page[length++] = ',';
+
+        mbedtls_base64_encode((unsigned char *) &p_page[length],
+                              BASE64_LENGTH + 1,
+                              &base64_length,
+                              p_ext_endpoint->id,
+                              EXT_ID_SIZE - padding);
+
+        length += BASE64_LENGTH;
+        p_page[length++] = '/';
+        p_page[length++] = '0' + (p_ext_endpoint->endpoint
+                                  & EXT_ENDPOINT_NUMBER_MASK);
+    }
+
+    return length;
+}
+
+
+static int8_t list_ack_handler(mqttsn_event_t * p_event, void * p_context);
+
+static int8_t list_page_send(void)
+{
+    // +1 for '\0' written by the encoder after the last name
+    char    page[CONFIG_LIST_PAGE_SIZE + 1];
+    uint8_t next;
+
+    uint16_t length = list_page_build(page, &next);
+
+    int8_t err_code = comm_manager_publish_stream(m_list_stream.topic_id,
+                                                  (uint8_t const *) page,
+                                                  length,
+                                                  list_ack_handler,
+                                                  NULL);
+    if (err_code)
+    {
+        m_list_stream.is_busy = false;
+        return -6;
+    }
+
+    m_list_stream.pages++;
+
+    // the stream ends with the last page or the page limit
+    if (   0 == next
+        || CONFIG_LIST_PAGES_MAX == m_list_stream.pages)
+        m_list_stream.cursor = 0;
+    else
+        m_list_stream.cursor = next;
+
+    return 0;
+}
+
+
+/*
+ * REGACK of the response topic and PUBACKs of the pages
+ */
+static int8_t list_ack_handler(mqttsn_event_t * p_event, void * p_context)
+{
+    if (false == m_list_stream.is_busy)
+        return -1;
+
+    if (MQTTSN_EVENT_TIMEOUT == p_event->event_id)
+    {
+        // the controller asks again with the last cursor it got
+        m_list_stream.is_busy = false;
+        return -2;
+    }
+
+    if (MQTTSN_EVENT_REGISTERED == p_event->event_id)
+        m_list_stream.topic_id = p_event->event_data.registered.packet.topic.topic_id;
+    else if (0 == m_list_stream.cursor)
+    {
+        m_list_stream.is_busy = false;
+        return 0;
+    }
+
+    return list_page_send();
+}
+
+
+static int8_t list_topic_register(void)
+{
+    char topic_name[CONFIG_LIST_TOPIC_LENGTH];
+
+    memcpy(topic_name, comm_utils_get_id(), BASE64_LENGTH);
+    memcpy(&topic_name[BASE64_LENGTH],
+           "/" SERVICE_STR_CONFIG_LIST,
+           sizeof("/" SERVICE_STR_CONFIG_LIST));
+
+    if (comm_manager_topic_register(topic_name,
+                                    &m_list_stream.msg_id,
+                                    list_ack_handler,
+                                    NULL))
+    {
+        m_list_stream.is_busy = false;
+        return -7;
+    }
+
+    return 0;
+}
+
+
+int8_t service_config_list(endpoint_t endpoint,
+                           uint8_t * p_msg,
+                           uint16_t msg_length)
+{
+    if (false == m_is_initialized)
+        return -1;
+
+    // the cursor in decimal, empty - from the beginning
+    uint16_t cursor = 0;
+
+    if (msg_length > 3)
+        return -2;
+
+    for (uint16_t i = 0; i < msg_length; i++)
+    {
+        if (p_msg[i] < '0' || p_msg[i] > '9')
+            return -2;
+
+        cursor = cursor * 10 + (p_msg[i] - '0');
+    }
+
+    if (cursor > UINT8_MAX)
+        return -2;
+
+    // one stream at a time - the controller asks once again
+    if (m_list_stream.is_busy)
+        return -8;
+
+    m_list_stream.is_busy  = true;
+    m_list_stream.endpoint = endpoint;
+    m_list_stream.cursor   = (uint8_t) cursor;
+    m_list_stream.pages    = 0;
+
+    if (0 == m_list_stream.topic_id)
+        return list_topic_register();
+
+    return list_page_send();
+}
@@ -17,10 +17,62 @@
 #include "service_setup.h"
 
 
+#define SERVICE_CONFIG_ALL_SUBSCRIBED_FLAG  (-9)
+
+
+/*
+ * Self endpoints as a bitmask (bit n - endpoint n)
+ */
+typedef uint8_t endpoint_mask_t;
+
+
+void service_config_init(void);
+
 int8_t service_config_subscribe(endpoint_t endpoint,
                                 uint8_t * p_msg,
                                 uint16_t msg_length);
 
-int8_t service_config_add_ext_topic(uint16_t ret_msg_id, uint16_t topic_id);
+/*
+ * Removes the endpoint from the group right away. The group is dropped when
+ * its last self endpoint leaves, the UNSUBSCRIBE is sent when the creation
+ * slot is free (or after the reconnection)
+ */
+int8_t service_config_unsubscribe(endpoint_t endpoint,
+                                  uint8_t * p_msg,
+                                  uint16_t msg_length);
+
+/*
+ * Streams the subscription list of the endpoint from the cursor (decimal
+ * payload, empty - the beginning) on the "<id>/config/list" topic, up to
+ * CONFIG_LIST_PAGES_MAX pages per request
+ */
+int8_t service_config_list(endpoint_t endpoint,
+                           uint8_t * p_msg,
+                           uint16_t msg_length);
+
+/*
+ * Called after (re)connection - on a clean session all groups lost their
+ * topic IDs and have to be subscribed once again
+ */
+void service_config_resume(bool is_clean_session);
+
+/*
+ * Unsubscribes the next group left by all self endpoints or subscribes
+ * the next group which lost its topic ID
+ * Returns SERVICE_CONFIG_ALL_SUBSCRIBED_FLAG if there is nothing to do
+ */
+int8_t service_config_continue(void);
+
+/*
+ * Returns the members of the group (ext index kept by service_dispatch),
+ * 0 if there is no such group
+ */
+endpoint_mask_t service_config_ext_endpoints_get(uint8_t ext_index);
+
+/*
+ * True for the registered '<id>/config/list' response topic - the device
+ * publishes on it, so the '<id>/#' subscription brings the pages back
+ */
+bool service_config_is_list_topic(uint16_t topic_id);
 
 #endif /* APP_SERVICE_CONFIG_H_ */
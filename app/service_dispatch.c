@@ -0,0 +1,188 @@
+/*
+ * service_dispatch.c
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: MSc Patryk Silkowski
+ */
+
+#include "service_dispatch.h"
+
+/* GCC */
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+
+/* SDK */
+#include "app_util.h"
+
+
+#define DISPATCH_MASK       (SERVICE_DISPATCH_TABLE_SIZE - 1)
+
+// the entries are counted in uint8_t
+STATIC_ASSERT(SERVICE_DISPATCH_TABLE_BITS <= 8);
+
+
+/*
+ * Open addressing with linear probing. Entries are removed with the backward
+ * shift, so there are no tombstones and a miss stops on the first empty entry
+ */
+static dispatch_entry_t m_table[SERVICE_DISPATCH_TABLE_SIZE];
+static uint8_t          m_entry_cnt = 0;
+
+
+/*
+ * Fibonacci hashing - the gateway assigns IDs sequentially, the multiplication
+ * spreads them over the whole table
+ */
+static uint16_t dispatch_hash(uint16_t topic_id)
+{
+    return (uint16_t) (topic_id * 40503U) >> (16 - SERVICE_DISPATCH_TABLE_BITS);
+}
+
+
+static dispatch_entry_t * dispatch_lookup(uint16_t topic_id)
+{
+    uint16_t idx = dispatch_hash(topic_id);
+
+    for (uint16_t i = 0; i < SERVICE_DISPATCH_TABLE_SIZE; i++)
+    {
+        dispatch_entry_t * p_entry = &m_table[idx];
+
+        if (0 == p_entry->topic_id)
+            return NULL;
+
+        if (topic_id == p_entry->topic_id)
+            return p_entry;
+
+        idx = (idx + 1) & DISPATCH_MASK;
+    }
+
+    return NULL;
+}
+
+
+/*
+ * Returns the entry of the topic ID or an empty one to be filled
+ */
+static dispatch_entry_t * dispatch_slot_get(uint16_t topic_id)
+{
+    if (0 == topic_id)
+        return NULL;
+
+    dispatch_entry_t * p_entry = dispatch_lookup(topic_id);
+
+    if (NULL != p_entry)
+        return p_entry;
+
+    // keep at least one empty entry to terminate the probing
+    if (m_entry_cnt >= SERVICE_DISPATCH_TABLE_SIZE - 1)
+        return NULL;
+
+    uint16_t idx = dispatch_hash(topic_id);
+
+    while (0 != m_table[idx].topic_id)
+        idx = (idx + 1) & DISPATCH_MASK;
+
+    m_entry_cnt++;
+    m_table[idx].topic_id = topic_id;
+
+    return &m_table[idx];
+}
+
+
+int8_t service_dispatch_add_self(uint16_t topic_id,
+                                 endpoint_t endpoint,
+                                 service_type_t type)
+{
+    dispatch_entry_t * p_entry = dispatch_slot_get(topic_id);
+
+    if (NULL == p_entry)
+        return -1;
+
+    p_entry->kind          = dispatch_self;
+    p_entry->self.endpoint = endpoint;
+    p_entry->self.type     = type;
+
+    return 0;
+}
+
+
+int8_t service_dispatch_add_ext(uint16_t topic_id, uint8_t ext_index)
+{
+    dispatch_entry_t * p_entry = dispatch_slot_get(topic_id);
+
+    if (NULL == p_entry)
+        return -1;
+
+    p_entry->kind      = dispatch_ext;
+    p_entry->ext_index = ext_index;
+
+    return 0;
+}
+
+
+static void dispatch_delete(dispatch_entry_t * p_entry)
+{
+    uint16_t hole = (uint16_t) (p_entry - m_table);
+    uint16_t idx  = hole;
+
+    // shift back the entries of the same cluster which probed over the hole
+    while (true)
+    {
+        idx = (idx + 1) & DISPATCH_MASK;
+
+        if (0 == m_table[idx].topic_id)
+            break;
+
+        uint16_t home = dispatch_hash(m_table[idx].topic_id);
+
+        // is the home of the entry cyclically in (hole, idx]?
+        if (((idx - home) & DISPATCH_MASK) >= ((idx - hole) & DISPATCH_MASK))
+        {
+            m_table[hole] = m_table[idx];
+            hole = idx;
+        }
+    }
+
+    memset(&m_table[hole], 0, sizeof(dispatch_entry_t));
+    m_entry_cnt--;
+}
+
+
+void service_dispatch_remove(uint16_t topic_id)
+{
+    if (0 == topic_id)
+        return;
+
+    dispatch_entry_t * p_entry = dispatch_lookup(topic_id);
+
+    if (NULL == p_entry)
+        return;
+
+    dispatch_delete(p_entry);
+}
+
+
+void service_dispatch_clear(dispatch_kind_t kind)
+{
+    // in place - the backward shift might move the next entry to i, so the
+    // entry is checked once again. Only the kept entries are shifted over
+    // the end of the table (the earlier ones of the kind are gone already)
+    for (uint16_t i = 0; i < SERVICE_DISPATCH_TABLE_SIZE; )
+    {
+        if (   0 != m_table[i].topic_id
+            && kind == m_table[i].kind)
+            dispatch_delete(&m_table[i]);
+        else
+            i++;
+    }
+}
+
+
+const dispatch_entry_t * service_dispatch_find(uint16_t topic_id)
+{
+    if (0 == topic_id)
+        return NULL;
+
+    return dispatch_lookup(topic_id);
+}
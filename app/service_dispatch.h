@@ -0,0 +1,72 @@
+/*
+ * service_dispatch.h
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: MSc Patryk Silkowski
+ */
+
+#ifndef APP_SERVICE_DISPATCH_H_
+#define APP_SERVICE_DISPATCH_H_
+
+/* GCC */
+#include <stdint.h>
+
+/* APP */
+#include "service_setup.h"
+
+
+/*
+ * Topic IDs are assigned by the gateway in any order (shared topics, restarts,
+ * predefined IDs), so the received PUBLISH is dispatched through the hash
+ * table instead of the topic ID ranges. The size keeps the load factor below
+ * ~0.75 for all self services and ext topics - the table has to grow with
+ * EXT_TOPIC_LIMIT (checked in service_config.c), up to 8 bits
+ */
+#ifndef SERVICE_DISPATCH_TABLE_BITS
+#define SERVICE_DISPATCH_TABLE_BITS     7
+#endif
+#define SERVICE_DISPATCH_TABLE_SIZE     (1 << SERVICE_DISPATCH_TABLE_BITS)
+
+
+typedef enum {
+    dispatch_self = 0,      // self service
+    dispatch_ext,           // external group (service_config)
+    dispatch_none
+} dispatch_kind_t;
+
+typedef struct {
+    uint16_t        topic_id;       // 0 - empty entry
+    dispatch_kind_t kind;
+    union {
+        struct {
+            endpoint_t     endpoint;
+            service_type_t type;
+        } self;
+        uint8_t ext_index;          // index of the ext topic
+    };
+} dispatch_entry_t;
+
+
+/*
+ * Adds or overwrites the entry of the topic ID
+ */
+int8_t service_dispatch_add_self(uint16_t topic_id,
+                                 endpoint_t endpoint,
+                                 service_type_t type);
+
+int8_t service_dispatch_add_ext(uint16_t topic_id, uint8_t ext_index);
+
+void service_dispatch_remove(uint16_t topic_id);
+
+/*
+ * Removes all entries of the kind (i.e. the database was cleared)
+ */
+void service_dispatch_clear(dispatch_kind_t kind);
+
+/*
+ * Returns NULL if the topic ID is unknown
+ */
+const dispatch_entry_t * service_dispatch_find(uint16_t topic_id);
+
+
+#endif /* APP_SERVICE_DISPATCH_H_ */
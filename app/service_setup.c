@@ -9,29 +9,40 @@
 #include "service_setup.h"
 
 /* GCC */
+#include <stddef.h>
 #include <string.h>
-#include <stdio.h>
+
+/* SDK */
+#include "app_timer.h"
+#include "app_util.h"
 
 /* APP */
 #include "comm_manager.h"
 #include "comm_utils.h"
+#include "mash_storage.h"
+#include "service_dispatch.h"
 
 
 #define SERVICE_DATA_ARRAY_SIZE       60
-#define SERVICE_CREATE_BUFFER_SIZE    4
+#define SERVICE_CREATE_BUFFER_SIZE    4     // window of services being created at once
 
 #define MQTTSN_TOPIC_NAME_LENGTH      32
 #define DEFAULT_RETRANSMISSION_CNT    4
 
+#define RETRY_TICKS_HALF_RANGE        0x800000  // half of the 24-bit RTC counter
+
+
+// "/<endpoint>/<type>" with '\0', i.e. "/9/config/unsub"
+#define SERVICE_TOPIC_SUFFIX_LENGTH   16
 
-#define SERVICE_STR_INFO          "info"
-#define SERVICE_STR_TIME          "time"
-#define SERVICE_STR_PREC          "prec"
-#define SERVICE_STR_ONOFF         "onoff"
-#define SERVICE_STR_TEMPHUM       "temphum"
-#define SERVICE_STR_CONFIG_SUB    "config/sub"
-#define SERVICE_STR_CONFIG_UNSUB  "config/unsub"
-#define SERVICE_STR_CONFIG_LIST   "config/list"
+#define SERVICE_TOPIC_SUFFIX_ROW(endpoint)                                    \
+        SERVICE_TYPE_STRINGS_PREFIXED("/" #endpoint "/")
+
+
+#define SERVICE_TICKS_TO_MS(ticks)                                            \
+        ((uint32_t) (((uint64_t) (ticks) * 1000                               \
+                      * (APP_TIMER_CONFIG_RTC_FREQUENCY + 1))                 \
+                     / APP_TIMER_CLOCK_FREQ))
 
 
 typedef struct {
@@ -39,95 +50,425 @@ typedef struct {
     char            topic_name[MQTTSN_TOPIC_NAME_LENGTH];
     uint16_t        message_id;
     uint8_t         retry_cnt;
+    uint32_t        sent_at;        // app_timer ticks of the last transmission
+    uint32_t        retry_at;       // app_timer ticks of the delayed retry
+    bool            retry_pending;  // waits for the backoff to expire
+    bool            retry_is_sub;   // SUBSCRIBE (or REGISTER) to be resent
+    bool            is_unsub;       // UNSUBSCRIBE of the topic, never in the database
     bool            is_created;
+    bool            is_self;        // created by the self services chain
+    bool            is_wildcard;    // '<id>/#' subscription, no service inside
+    service_owner_cb owner_cb;      // gets the SUBACK instead of the database
 } create_service_t;
 
+/*
+ * Topic IDs are valid only within the gateway session, so the cache is keyed
+ * with the gateway ID and the client ID used for the connection
+ */
+typedef struct {
+    uint8_t         gateway_id;
+    uint8_t         service_cnt;
+    char            client_id[BASE64_LENGTH + 1];
+    service_data_t  services[SERVICE_DATA_ARRAY_SIZE];
+} topic_cache_t;
+
+STATIC_ASSERT(sizeof(topic_cache_t) <= MASH_STORAGE_RECORD_SIZE_MAX);
+
 
 // TODO there are 40 self topics probably
 static service_data_t   m_service_database[SERVICE_DATA_ARRAY_SIZE];
 static uint8_t          m_service_cnt     =  0;
 
 
+static const char * const m_service_type_str[type_none] = SERVICE_TYPE_STRINGS;
+
+/*
+ * Topic names are spliced from the base64 ID and the suffix taken from ROM,
+ * so no formatting is done while the services are created
+ */
+static const char m_topic_suffix[SERVICE_ENDPOINT_MAX + 1][type_none]
+                                [SERVICE_TOPIC_SUFFIX_LENGTH] =
+{
+    SERVICE_TOPIC_SUFFIX_ROW(0),
+    SERVICE_TOPIC_SUFFIX_ROW(1),
+    SERVICE_TOPIC_SUFFIX_ROW(2),
+    SERVICE_TOPIC_SUFFIX_ROW(3),
+    SERVICE_TOPIC_SUFFIX_ROW(4),
+    SERVICE_TOPIC_SUFFIX_ROW(5),
+    SERVICE_TOPIC_SUFFIX_ROW(6),
+    SERVICE_TOPIC_SUFFIX_ROW(7),
+    SERVICE_TOPIC_SUFFIX_ROW(8),
+    SERVICE_TOPIC_SUFFIX_ROW(9),
+};
+
+STATIC_ASSERT(BASE64_LENGTH + SERVICE_TOPIC_SUFFIX_LENGTH
+                                                <= MQTTSN_TOPIC_NAME_LENGTH);
+
+// the predefined IDs never meet the normal ones, 0xFFFF is reserved
+STATIC_ASSERT(SERVICE_PREDEFINED_TOPIC_BASE > SERVICE_NORMAL_TOPIC_ID_MAX);
+STATIC_ASSERT(SERVICE_PREDEFINED_TOPIC_BASE + SERVICE_SELF_TOPIC_ID_MAX - 1
+                                                                < 0xFFFF);
+STATIC_ASSERT(SERVICE_BSP_ENDPOINTS * type_none <= SERVICE_SELF_TOPIC_ID_MAX);
+
+int8_t database_delete_with_topic_id(uint16_t topic_id);
+static int8_t setup_subscribe(create_service_t * p_setup);
+static int8_t slot_ack_handler(mqttsn_event_t * p_event, void * p_context);
+
 static endpoint_t       m_iter_endpoints  =  0;
 static service_type_t   m_iter_services   =  0;
 
-static uint16_t         m_msg_ids         =  0;
-static create_service_t m_srv_setup       = {0};
+static create_service_t m_srv_setup[SERVICE_CREATE_BUFFER_SIZE];
+
+static uint8_t          m_session_gateway_id = 0;
+
+APP_TIMER_DEF(m_retry_timer);
+static bool             m_retry_timer_created = false;
+
+static uint32_t         m_provision_start =  0;     // app_timer ticks
+static uint32_t         m_provision_time  =  0;     // [ms], 0 if not finished
+
+
+/*
+ * The database is kept sorted by the (endpoint, type) key, so the lookup,
+ * insertion and deletion are a binary search (+ memmove of the tail)
+ * Pointers returned by database_find() are valid until the next add/delete
+ */
+static uint16_t database_key(endpoint_t endpoint, service_type_t type)
+{
+    return (uint16_t) endpoint * type_none + type;
+}
+
+
+/*
+ * Returns index of the service or the index it should be inserted at
+ */
+static uint8_t database_search(uint16_t key, bool * p_found)
+{
+    uint8_t low  = 0;
+    uint8_t high = m_service_cnt;
+
+    while (low < high)
+    {
+        uint8_t  mid     = low + (high - low) / 2;
+        uint16_t mid_key = database_key(m_service_database[mid].endpoint,
+                                        m_service_database[mid].type);
+
+        if (mid_key == key)
+        {
+            *p_found = true;
+            return mid;
+        }
+
+        if (mid_key < key)
+            low = mid + 1;
+        else
+            high = mid;
+    }
+
+    *p_found = false;
+    return low;
+}
+
+
+/*
+ * Adds the service or updates the topic ID of the existing one
+ */
+int8_t database_add(service_data_t * p_data)
+{
+    if (   NULL == p_data
+        || p_data->type >= type_none
+        || p_data->endpoint >= SERVICE_BSP_ENDPOINTS)
+        return -1;
+
+    // the topic ID was given to another service (new session), the stale
+    // service is dropped, otherwise it would keep the ID of the other one
+    const dispatch_entry_t * p_owner = service_dispatch_find(p_data->topic_id);
+
+    if (   NULL != p_owner
+        && dispatch_self == p_owner->kind
+        && (   p_data->endpoint != p_owner->self.endpoint
+            || p_data->type != p_owner->self.type))
+    {
+        (void) database_delete_with_topic_id(p_data->topic_id);
+    }
+
+    bool    found;
+    uint8_t idx = database_search(database_key(p_data->endpoint, p_data->type),
+                                  &found);
+
+    if (found)
+    {
+        service_dispatch_remove(m_service_database[idx].topic_id);
+    }
+    else
+    {
+        if (m_service_cnt >= SERVICE_DATA_ARRAY_SIZE)
+            return -2;
+
+        memmove(&m_service_database[idx + 1],
+                &m_service_database[idx],
+                (m_service_cnt - idx) * sizeof(service_data_t));
+        m_service_cnt++;
+    }
+
+    m_service_database[idx] = *p_data;
+
+    return service_dispatch_add_self(p_data->topic_id,
+                                     p_data->endpoint,
+                                     p_data->type);
+}
+
+
+void database_clear(void)
+{
+    memset(m_service_database, 0, sizeof(m_service_database));
+    m_service_cnt = 0;
+
+    service_dispatch_clear(dispatch_self);
+}
 
 
-void database_add(service_data_t * p_data)
+service_data_t * database_find(endpoint_t endpoint, service_type_t type)
 {
-    if (NULL == p_data)
-        return;
+    bool    found;
+    uint8_t idx = database_search(database_key(endpoint, type), &found);
 
-    m_service_database[m_service_cnt] = *p_data;
-    m_service_cnt++;
+    return found ? &m_service_database[idx] : NULL;
 }
 
 
-void database_delete_with_topic_id(uint16_t topic_id)
+int8_t database_delete_with_topic_id(uint16_t topic_id)
 {
-    //here will be set binary search probably
+    const dispatch_entry_t * p_entry = service_dispatch_find(topic_id);
+
+    if (   NULL == p_entry
+        || dispatch_self != p_entry->kind)
+        return -1;
+
+    bool    found;
+    uint8_t idx = database_search(database_key(p_entry->self.endpoint,
+                                               p_entry->self.type),
+                                  &found);
+
+    service_dispatch_remove(topic_id);
+
+    if (false == found)
+        return -2;
+
+    // compact the database
+    m_service_cnt--;
+    memmove(&m_service_database[idx],
+            &m_service_database[idx + 1],
+            (m_service_cnt - idx) * sizeof(service_data_t));
+    memset(&m_service_database[m_service_cnt], 0, sizeof(service_data_t));
+
+    return 0;
 }
 
 
 int8_t mash_topic_name_serial(char * id_str, create_service_t * dataset)
 {
-    char str_service_type[SERVICE_STR_MAX_LENGTH] = {0};
-    int8_t ret;
+    if (   dataset->service.type >= type_none
+        || dataset->service.endpoint > SERVICE_ENDPOINT_MAX)
+        return -1;
+
+    memcpy(dataset->topic_name, id_str, BASE64_LENGTH);
+    memcpy(&dataset->topic_name[BASE64_LENGTH],
+           m_topic_suffix[dataset->service.endpoint][dataset->service.type],
+           SERVICE_TOPIC_SUFFIX_LENGTH);
+
+    return 0;
+}
+
 
-    switch (dataset->service.type)
+static int8_t slot_alloc(void)
+{
+    for (uint8_t slot = 0; slot < SERVICE_CREATE_BUFFER_SIZE; slot++)
     {
-        case info:
-            ret = (int8_t) snprintf(str_service_type,
-                                    SERVICE_STR_MAX_LENGTH,
-                                    SERVICE_STR_INFO);
-        break;
-
-        case onoff:
-            ret = (int8_t) snprintf(str_service_type,
-                                    SERVICE_STR_MAX_LENGTH,
-                                    SERVICE_STR_ONOFF);
-        break;
-
-        case config_sub:
-            ret = (int8_t) snprintf(str_service_type,
-                                    SERVICE_STR_MAX_LENGTH,
-                                    SERVICE_STR_CONFIG_SUB);
-        break;
-
-        case config_unsub:
-            ret = (int8_t) snprintf(str_service_type,
-                                    SERVICE_STR_MAX_LENGTH,
-                                    SERVICE_STR_CONFIG_UNSUB);
-        break;
-
-        case config_list:
-            ret = (int8_t) snprintf(str_service_type,
-                                    SERVICE_STR_MAX_LENGTH,
-                                    SERVICE_STR_CONFIG_LIST);
-        break;
-
-        case type_none:
-        default:
-            return -1;
-        break;
-    } // end of switch
-
-    if (ret < 0)
-        return -1;
+        if (false == m_srv_setup[slot].is_created)
+        {
+            memset(&m_srv_setup[slot], 0, sizeof(create_service_t));
+            return (int8_t) slot;
+        }
+    }
+
+    return SERVICE_BUSY_FLAG;
+}
+
+
+static uint8_t self_services_pending(void)
+{
+    uint8_t cnt = 0;
+
+    for (uint8_t i = 0; i < SERVICE_CREATE_BUFFER_SIZE; i++)
+    {
+        if (m_srv_setup[i].is_created && m_srv_setup[i].is_self)
+            cnt++;
+    }
+
+    return cnt;
+}
+
 
-    ret = (int8_t) snprintf(dataset->topic_name,
-                            MQTTSN_TOPIC_NAME_LENGTH,
-                            "%s/%d/%s",
-                            id_str,
-                            dataset->service.endpoint,
-                            str_service_type);
+bool service_is_inbound(endpoint_t endpoint, service_type_t type)
+{
+    if (   onoff == type
+        && endpoint >= SERVICE_BSP_SW0)
+        return false;
+
+    return true;
+}
+
+
+static create_service_t * slot_find_service(endpoint_t endpoint,
+                                            service_type_t type)
+{
+    for (uint8_t i = 0; i < SERVICE_CREATE_BUFFER_SIZE; i++)
+    {
+        if (   m_srv_setup[i].is_created
+            && m_srv_setup[i].service.endpoint == endpoint
+            && m_srv_setup[i].service.type == type)
+        {
+            return &m_srv_setup[i];
+        }
+    }
+
+    return NULL;
+}
+
+
+static void self_services_iter_next(void)
+{
+    m_iter_services++;
+
+    if (type_none == m_iter_services)
+    {
+        m_iter_services = info;
+        m_iter_endpoints++;
+    }
+}
+
+
+/*
+ * Single '<id>/#' subscription in place of all the self services. The topic
+ * IDs are learned later on from REGISTER messages sent by the gateway
+ * (see service_learn_topic)
+ */
+static int8_t self_services_wildcard(void)
+{
+    if (m_iter_endpoints == SERVICE_BSP_ENDPOINTS)
+        return 0;   //already subscribed
+
+    int8_t slot = slot_alloc();
+
+    if (slot < 0)
+        return slot;
+
+    create_service_t * p_setup = &m_srv_setup[slot];
 
-    if (ret < 0)
+    p_setup->is_created  = true;
+    p_setup->is_self     = true;
+    p_setup->is_wildcard = true;
+
+    memcpy(p_setup->topic_name, comm_utils_get_id(), BASE64_LENGTH);
+    memcpy(&p_setup->topic_name[BASE64_LENGTH], "/#", sizeof("/#"));
+
+    if (setup_subscribe(p_setup))
+    {
+        service_destroy((uint8_t) slot);
         return -1;
-    else
-        return 0;
+    }
+
+    m_iter_endpoints = SERVICE_BSP_ENDPOINTS;
+    return 0;
+}
+
+
+/*
+ * Predefined topics mode - the topic IDs of all the self services are known
+ * up front, so the database is filled from the table without a single
+ * REGISTER or per-service SUBSCRIBE. The SDK client builds the SUBSCRIBE only
+ * with the topic name, so the topics are subscribed with the '<id>/#'
+ * wildcard and the gateway delivers them with the predefined IDs
+ */
+static int8_t self_services_predefined(void)
+{
+    if (m_iter_endpoints == SERVICE_BSP_ENDPOINTS)
+        return 0;   //already subscribed
+
+    for (endpoint_t endpoint = 0; endpoint < SERVICE_BSP_ENDPOINTS; endpoint++)
+    {
+        for (service_type_t type = info; type < type_none; type++)
+        {
+            service_data_t service =
+            {
+                .topic_id = SERVICE_PREDEFINED_TOPIC_ID(endpoint, type),
+                .type     = type,
+                .endpoint = endpoint,
+            };
+
+            int8_t err_code = database_add(&service);
+
+            if (err_code)
+                return err_code;
+        }
+    }
+
+    return self_services_wildcard();
+}
+
+
+/*
+ * Keeps the creation window full - each free slot gets the next self service
+ * and sends its SUBSCRIBE, so up to SERVICE_CREATE_BUFFER_SIZE transactions
+ * are in flight at once
+ *
+ * The SUBACK carries the topic ID, so there is no need to REGISTER the
+ * subscribed topics. Topics the device only publishes on are registered on
+ * their first use (see service_topic_id_get)
+ */
+static int8_t self_services_fill_window(void)
+{
+    if (SERVICE_PREDEFINED_TOPICS)
+        return self_services_predefined();
+
+    if (SERVICE_WILDCARD_SUBSCRIPTION)
+        return self_services_wildcard();
+
+    while (m_iter_endpoints < SERVICE_BSP_ENDPOINTS)
+    {
+        // the service survived the reconnection or is not subscribed at all
+        if (   NULL != database_find(m_iter_endpoints, m_iter_services)
+            || false == service_is_inbound(m_iter_endpoints, m_iter_services))
+        {
+            self_services_iter_next();
+            continue;
+        }
+
+        int8_t slot = service_create(comm_utils_get_id(),
+                                     m_iter_endpoints,
+                                     m_iter_services);
+
+        if (SERVICE_BUSY_FLAG == slot)
+            return 0;   //window is full, wait for the acknowledgements
+
+        if (slot < 0)
+            return slot;
+
+        m_srv_setup[slot].is_self = true;
+
+        int8_t ret = service_subscribe((uint8_t) slot, NULL);
+
+        if (ret)
+        {
+            service_destroy((uint8_t) slot);
+            return ret;
+        }
+
+        self_services_iter_next();
+    }
+
+    return 0;
 }
 
 
@@ -148,193 +489,581 @@ int8_t service_create(char * p_base_id,
     if (type >= type_none)
         return -4;
 
-    memset(&m_srv_setup, 0, sizeof(create_service_t));
+    int8_t slot = slot_alloc();
+
+    if (slot < 0)
+        return slot;
+
+    create_service_t * p_setup = &m_srv_setup[slot];
 
-    m_srv_setup.service.endpoint = endpoint;
-    m_srv_setup.service.type = type;
-    m_srv_setup.message_id = m_msg_ids++;
-    m_srv_setup.is_created = true;
+    p_setup->service.endpoint = endpoint;
+    p_setup->service.type = type;
+    p_setup->is_created = true;
 
     //serial var
-    return mash_topic_name_serial(p_base_id, &m_srv_setup);
+    if (mash_topic_name_serial(p_base_id, p_setup))
+    {
+        service_destroy(slot);
+        return -1;
+    }
+
+    return slot;
 }
 
 
 //static inline (?)
-void service_destroy(void)
+void service_destroy(uint8_t slot)
+{
+    if (slot < SERVICE_CREATE_BUFFER_SIZE)
+        memset(&m_srv_setup[slot], 0, sizeof(create_service_t));
+}
+
+
+bool service_is_created(uint8_t slot, uint16_t * msg_id)
+{
+    if (slot >= SERVICE_CREATE_BUFFER_SIZE)
+        return false;
+
+    *msg_id = m_srv_setup[slot].message_id;
+    return m_srv_setup[slot].is_created;
+}
+
+
+static int8_t setup_register(create_service_t * p_setup)
 {
-    memset(&m_srv_setup, 0, sizeof(create_service_t));
+    p_setup->sent_at = app_timer_cnt_get();
+
+    return comm_manager_topic_register(p_setup->topic_name,
+                                       &p_setup->message_id,
+                                       slot_ack_handler,
+                                       p_setup);
 }
 
+static int8_t setup_subscribe(create_service_t * p_setup)
+{
+    p_setup->sent_at = app_timer_cnt_get();
+
+    return comm_manager_topic_subscribe(p_setup->topic_name,
+                                        &p_setup->message_id,
+                                        slot_ack_handler,
+                                        p_setup);
+}
 
-bool service_is_created(uint16_t * msg_id)
+static int8_t setup_unsubscribe(create_service_t * p_setup)
 {
-    *msg_id = m_srv_setup.message_id;
-    return m_srv_setup.is_created;
+    p_setup->sent_at = app_timer_cnt_get();
+
+    return comm_manager_topic_unsubscribe(p_setup->topic_name,
+                                          &p_setup->message_id,
+                                          slot_ack_handler,
+                                          p_setup);
 }
 
 
-int8_t service_register(void)
+static int8_t setup_send(create_service_t * p_setup)
 {
-    if (false == m_srv_setup.is_created)
+    if (p_setup->is_unsub)
+        return setup_unsubscribe(p_setup);
+
+    return p_setup->retry_is_sub ? setup_subscribe(p_setup)
+                                 : setup_register(p_setup);
+}
+
+
+/*
+ * Runs the retry timer till the earliest pending retry
+ */
+static void retry_timer_arm(void)
+{
+    uint32_t now     = app_timer_cnt_get();
+    uint32_t min_due = RETRY_TICKS_HALF_RANGE;
+
+    for (uint8_t i = 0; i < SERVICE_CREATE_BUFFER_SIZE; i++)
+    {
+        if (   false == m_srv_setup[i].is_created
+            || false == m_srv_setup[i].retry_pending)
+            continue;
+
+        uint32_t due = app_timer_cnt_diff_compute(m_srv_setup[i].retry_at, now);
+
+        // already expired (the counter passed the retry_at)
+        if (due >= RETRY_TICKS_HALF_RANGE)
+            due = 0;
+
+        if (due < min_due)
+            min_due = due;
+    }
+
+    app_timer_stop(m_retry_timer);
+
+    if (RETRY_TICKS_HALF_RANGE == min_due)
+        return;     // nothing to retry
+
+    if (min_due < APP_TIMER_MIN_TIMEOUT_TICKS)
+        min_due = APP_TIMER_MIN_TIMEOUT_TICKS;
+
+    app_timer_start(m_retry_timer, min_due, NULL);
+}
+
+
+/*
+ * Resends all the expired retries (scheduler context)
+ */
+static void retry_timer_handler(void * p_context)
+{
+    uint32_t now = app_timer_cnt_get();
+
+    for (uint8_t i = 0; i < SERVICE_CREATE_BUFFER_SIZE; i++)
+    {
+        create_service_t * p_setup = &m_srv_setup[i];
+
+        if (   false == p_setup->is_created
+            || false == p_setup->retry_pending)
+            continue;
+
+        if (app_timer_cnt_diff_compute(now, p_setup->retry_at)
+                                                    >= RETRY_TICKS_HALF_RANGE)
+            continue;   // not yet
+
+        p_setup->retry_pending = false;
+
+        int8_t err_code = setup_send(p_setup);
+
+        // the client queue is still full - back off once again
+        if (err_code)
+        {
+            p_setup->retry_pending = true;
+            p_setup->retry_at = now + APP_TIMER_TICKS(
+                    comm_manager_backoff_ms(p_setup->retry_cnt, true));
+            continue;
+        }
+
+        comm_manager_retry_sent();
+    }
+
+    retry_timer_arm();
+}
+
+
+/*
+ * Delays the retransmission with the exponential backoff instead of resending
+ * right away - the immediate retries of a whole network amplify the congestion
+ */
+static int8_t retry_schedule(create_service_t * p_setup,
+                             bool is_sub,
+                             bool is_congestion)
+{
+    p_setup->retry_cnt++;
+    if (DEFAULT_RETRANSMISSION_CNT == p_setup->retry_cnt)
+    {
+        // the slot goes back to the window, the owner is not left pending
+        service_owner_cb owner_cb = p_setup->owner_cb;
+
+        memset(p_setup, 0, sizeof(create_service_t));
+
+        if (NULL != owner_cb)
+            owner_cb(0, false);
+
+        //shit happens... consider disconnecting from the gateway
+        return SERVICE_RETRY_CNT_MAX_FLAG;
+    }
+
+    if (false == m_retry_timer_created)
+    {
+        if (app_timer_create(&m_retry_timer,
+                             APP_TIMER_MODE_SINGLE_SHOT,
+                             retry_timer_handler))
+            return -3;
+
+        m_retry_timer_created = true;
+    }
+
+    uint32_t delay_ms = comm_manager_backoff_ms(p_setup->retry_cnt - 1,
+                                                is_congestion);
+
+    p_setup->retry_is_sub  = is_sub;
+    p_setup->retry_pending = true;
+    p_setup->retry_at      = app_timer_cnt_get() + APP_TIMER_TICKS(delay_ms);
+
+    retry_timer_arm();
+    return 0;
+}
+
+
+int8_t service_register(uint8_t slot)
+{
+    if (   slot >= SERVICE_CREATE_BUFFER_SIZE
+        || false == m_srv_setup[slot].is_created)
         return -1;
 
-    return comm_manager_topic_register(m_srv_setup.topic_name,
-                                       &m_srv_setup.message_id);
+    return setup_register(&m_srv_setup[slot]);
 }
 
-int8_t service_subscribe(void)
+int8_t service_subscribe(uint8_t slot, service_owner_cb owner_cb)
 {
-    if (false == m_srv_setup.is_created)
+    if (   slot >= SERVICE_CREATE_BUFFER_SIZE
+        || false == m_srv_setup[slot].is_created)
         return -1;
 
-    return comm_manager_topic_subscribe(m_srv_setup.topic_name,
-                                        &m_srv_setup.message_id);
+    m_srv_setup[slot].owner_cb = owner_cb;
+
+    return setup_subscribe(&m_srv_setup[slot]);
 }
 
-int8_t service_subscribe_to_registered(uint16_t msg_id, uint16_t topic_id)
+int8_t service_unsubscribe(uint8_t slot, service_owner_cb owner_cb)
 {
-    //check message ID
-    if (m_srv_setup.message_id != msg_id)
-        return -2;
+    if (   slot >= SERVICE_CREATE_BUFFER_SIZE
+        || false == m_srv_setup[slot].is_created
+        || NULL == owner_cb)
+        return -1;
+
+    m_srv_setup[slot].owner_cb = owner_cb;
+    m_srv_setup[slot].is_unsub = true;
+
+    return setup_unsubscribe(&m_srv_setup[slot]);
+}
+
+int8_t service_topic_id_get(endpoint_t endpoint,
+                            service_type_t type,
+                            uint16_t * p_topic_id)
+{
+    service_data_t * p_service = database_find(endpoint, type);
+
+    if (NULL != p_service)
+    {
+        *p_topic_id = p_service->topic_id;
+        return 0;
+    }
 
-    //change message ID
-    m_srv_setup.message_id = m_msg_ids++;
+    if (SERVICE_PREDEFINED_TOPICS)
+    {
+        *p_topic_id = SERVICE_PREDEFINED_TOPIC_ID(endpoint, type);
+        return 0;
+    }
+
+    // the registration is on the way already
+    if (NULL != slot_find_service(endpoint, type))
+        return SERVICE_PENDING_FLAG;
+
+    int8_t slot = service_create(comm_utils_get_id(), endpoint, type);
+
+    if (slot < 0)
+        return slot;
 
-    //store the topic ID (probably do not need this atm)
-    m_srv_setup.service.topic_id = topic_id;
+    int8_t ret = service_register((uint8_t) slot);
 
-    return service_subscribe();
+    if (ret)
+    {
+        service_destroy((uint8_t) slot);
+        return ret;
+    }
+
+    return SERVICE_PENDING_FLAG;
 }
 
-int8_t service_insert_to_database(uint16_t msg_id, uint16_t topic_id)
+static int8_t slot_insert_to_database(create_service_t * p_setup,
+                                      uint16_t topic_id)
 {
-    if (false == m_srv_setup.is_created)
-        return -1;
+    //the wildcard SUBACK carries no topic ID, services come with REGISTERs
+    if (p_setup->is_wildcard)
+    {
+        memset(p_setup, 0, sizeof(create_service_t));
+        return 0;
+    }
 
-    //check message ID
-    if (m_srv_setup.message_id != msg_id)
-        return -2;
+    // Karn's algorithm - the RTT of retransmitted messages is ambiguous
+    if (0 == p_setup->retry_cnt)
+    {
+        comm_manager_rtt_sample(SERVICE_TICKS_TO_MS(
+                app_timer_cnt_diff_compute(app_timer_cnt_get(),
+                                           p_setup->sent_at)));
+    }
 
     //check if topic is already there
-    if (0 == m_srv_setup.service.topic_id)
-        m_srv_setup.service.topic_id = topic_id;  //store the topic ID
+    if (0 == p_setup->service.topic_id)
+        p_setup->service.topic_id = topic_id;  //store the topic ID
 
     //check if topic ID matches with the one previously stored
-    if (m_srv_setup.service.topic_id != topic_id)
+    if (p_setup->service.topic_id != topic_id)
+    {
+        memset(p_setup, 0, sizeof(create_service_t));
         return -3;
+    }
 
     //add to database
-    database_add(&m_srv_setup.service);
-    service_destroy();
+    int8_t err_code = database_add(&p_setup->service);
+    memset(p_setup, 0, sizeof(create_service_t));
 
-    return 0;
+    return err_code;
 }
 
-int8_t service_retry_register(uint16_t msg_id)
+/*
+ * Owner of the REGISTER/SUBSCRIBE transactions sent from the slots
+ * (comm_manager_inflight_resolve)
+ */
+static int8_t slot_ack_handler(mqttsn_event_t * p_event, void * p_context)
 {
-    //check message ID
-    if (m_srv_setup.message_id != msg_id)
+    create_service_t * p_setup = (create_service_t *) p_context;
+
+    bool     is_timeout = (MQTTSN_EVENT_TIMEOUT == p_event->event_id);
+    uint16_t msg_id     = is_timeout ? p_event->event_data.error.msg_id
+                                     : p_event->event_data.registered.packet.id;
+
+    // the slot was dropped in the meantime (reconnection)
+    if (   false == p_setup->is_created
+        || msg_id != p_setup->message_id)
         return -2;
 
-    m_srv_setup.retry_cnt++;
-    if (DEFAULT_RETRANSMISSION_CNT == m_srv_setup.retry_cnt)
+    if (is_timeout)
     {
-        //shit happens... consider disconnecting from the gateway
-        return SERVICE_RETRY_CNT_MAX_FLAG;
+        return retry_schedule(
+            p_setup,
+            MQTTSN_PACKET_SUBACK == p_event->event_data.error.msg_type,
+            MQTTSN_ERROR_REJECTED_CONGESTION == p_event->event_data.error.error);
+    }
+
+    // the service is handled by another module (i.e. external group)
+    if (NULL != p_setup->owner_cb)
+    {
+        service_owner_cb owner_cb = p_setup->owner_cb;
+
+        // UNSUBACK carries no topic ID
+        uint16_t topic_id = p_setup->is_unsub
+                ? 0
+                : p_event->event_data.subscribed.packet.topic.topic_id;
+
+        memset(p_setup, 0, sizeof(create_service_t));
+        return owner_cb(topic_id, true);
     }
 
-    return service_register();
+    return slot_insert_to_database(
+                p_setup,
+                p_event->event_data.registered.packet.topic.topic_id);
 }
 
-int8_t service_retry_subscribe(uint16_t msg_id)
+static int8_t cache_load(uint8_t gateway_id, topic_cache_t * p_cache)
 {
-    //check message ID
-    if (m_srv_setup.message_id != msg_id)
+    uint16_t length = sizeof(topic_cache_t);
+
+    if (mash_storage_read(storage_topic_cache, p_cache, &length))
+        return -1;
+
+    if (length != offsetof(topic_cache_t, services)
+                  + p_cache->service_cnt * sizeof(service_data_t))
         return -2;
 
-    m_srv_setup.retry_cnt++;
-    if (DEFAULT_RETRANSMISSION_CNT == m_srv_setup.retry_cnt)
+    if (gateway_id != p_cache->gateway_id)
+        return -3;
+
+    if (strncmp(p_cache->client_id, comm_utils_get_id(), BASE64_LENGTH))
+        return -4;
+
+    return 0;
+}
+
+
+bool service_cache_is_valid(uint8_t gateway_id)
+{
+    topic_cache_t cache;
+
+    return 0 == cache_load(gateway_id, &cache);
+}
+
+
+static int8_t cache_restore(uint8_t gateway_id)
+{
+    topic_cache_t cache;
+
+    int8_t err_code = cache_load(gateway_id, &cache);
+
+    if (err_code)
+        return err_code;
+
+    database_clear();
+
+    if (cache.service_cnt > SERVICE_DATA_ARRAY_SIZE)
+        return -3;
+
+    for (uint8_t i = 0; i < cache.service_cnt; i++)
     {
-        //shit happens... consider disconnecting from the gateway
-        return SERVICE_RETRY_CNT_MAX_FLAG;
+        database_add(&cache.services[i]);
     }
 
-    return service_subscribe();
+    return 0;
 }
 
-// probably this will be external (triggered with GW_CONN_CB)
-// might be put to app scheduler
-int8_t create_self_services_init(void)
+
+static int8_t self_services_start(void)
 {
-    //generate self base64
-    comm_utils_id_gen();
+    //drop whatever was left from the previous (broken) creation chain
+    memset(m_srv_setup, 0, sizeof(m_srv_setup));
 
+    if (m_retry_timer_created)
+        app_timer_stop(m_retry_timer);
 
     //start the chain of creating->registering->subscribing all self services
     //iterate with endpoints and service types
     m_iter_endpoints = SERVICE_BSP_LED0;
     m_iter_services = info;
 
-    // hit first self service creation
-    int8_t ret = service_create(comm_utils_get_id(),
-                                m_iter_endpoints,
-                                m_iter_services);
+    m_provision_start = app_timer_cnt_get();
+    m_provision_time = 0;
+
+    // hit first window of self service creation
+    return create_self_services_continue();
+}
+
+// probably this will be external (triggered with GW_CONN_CB)
+// might be put to app scheduler
+int8_t create_self_services_init(uint8_t gateway_id)
+{
+    //generate self base64
+    comm_utils_id_gen();
+
+    database_clear();
+    m_session_gateway_id = gateway_id;
+
+    return self_services_start();
+}
 
-    if (!ret)
+int8_t create_self_services_resume(uint8_t gateway_id)
+{
+    // after reboot the database is empty - take it from the flash cache
+    if (   0 == m_service_cnt
+        || gateway_id != m_session_gateway_id)
     {
-        ret = service_register();
+        database_clear();
+        (void) cache_restore(gateway_id);
     }
 
-    return ret;
+    m_session_gateway_id = gateway_id;
+
+    // only the services missing in the database are created
+    return self_services_start();
+}
+
+bool service_session_is_resumable(uint8_t gateway_id)
+{
+    if (   m_service_cnt
+        && gateway_id == m_session_gateway_id)
+        return true;
+
+    return service_cache_is_valid(gateway_id);
 }
 
 int8_t create_self_services_continue(void)
 {
-    if (   m_iter_endpoints  == SERVICE_BSP_ENDPOINTS
-        && m_iter_services   == type_none    )
-        return 0;   //all self services already registered!
+    int8_t ret = self_services_fill_window();
 
-    m_iter_services++;
+    if (ret)
+        return ret;
 
-    if (type_none == m_iter_services)
+    if (   m_iter_endpoints == SERVICE_BSP_ENDPOINTS
+        && 0 == self_services_pending())
     {
-        m_iter_endpoints++;
-
-        if (SERVICE_BSP_ENDPOINTS == m_iter_endpoints)
-        {
-            return SERVICE_ALL_REGISTERED_FLAG;
-        }
-        else
+        //all self services already registered!
+        if (0 == m_provision_time)
         {
-            m_iter_services = info;
+            m_provision_time = SERVICE_TICKS_TO_MS(
+                app_timer_cnt_diff_compute(app_timer_cnt_get(),
+                                           m_provision_start));
         }
+
+        return SERVICE_ALL_REGISTERED_FLAG;
     }
 
-    // hit next self service creation
-    int8_t ret = service_create(comm_utils_get_id(),
-                                m_iter_endpoints,
-                                m_iter_services);
+    return 0;
+}
 
-    if (!ret)
-    {
-        ret = service_register();
-    }
+uint32_t service_provisioning_time_ms(void)
+{
+    return m_provision_time;
+}
+
+
+int8_t service_cache_store(uint8_t gateway_id)
+{
+    topic_cache_t cache;
+    topic_cache_t stored;
+
+    memset(&cache, 0, sizeof(topic_cache_t));
+
+    cache.gateway_id  = gateway_id;
+    cache.service_cnt = m_service_cnt;
+    strncpy(cache.client_id, comm_utils_get_id(), BASE64_LENGTH);
+    memcpy(cache.services,
+           m_service_database,
+           m_service_cnt * sizeof(service_data_t));
+
+    uint16_t length        = offsetof(topic_cache_t, services)
+                             + m_service_cnt * sizeof(service_data_t);
+    uint16_t stored_length = sizeof(topic_cache_t);
+
+    // the services are ready on every resume (and every wake of the sleepy
+    // node), erase the page only if the record has changed
+    if (   0 == mash_storage_read(storage_topic_cache, &stored, &stored_length)
+        && length == stored_length
+        && 0 == memcmp(&cache, &stored, length))
+        return 0;
 
-    return ret;
+    return mash_storage_write(storage_topic_cache, &cache, length);
 }
 
-service_data_t * service_pop_with_topic_id(uint16_t topic_id)
+int8_t service_learn_topic(uint16_t topic_id,
+                           const char * p_topic_name,
+                           uint16_t name_length)
 {
-    // the topic IDs are client-oriented so there is no need to seach them
-    // so the topic ID is an index as well
-    if(topic_id == m_service_database[topic_id - 1].topic_id)
+    // valid pattern: <self id>/<endpoint>/<service type>
+    const char * p_id = comm_utils_get_id();
+
+    if (   NULL == p_topic_name
+        || 0 == topic_id)
+        return -1;
+
+    // the name is not terminated - nothing is read past name_length
+    if (   name_length <= BASE64_LENGTH + 3
+        || memcmp(p_topic_name, p_id, BASE64_LENGTH)
+        || '/' != p_topic_name[BASE64_LENGTH]
+        || '/' != p_topic_name[BASE64_LENGTH + 2])
+        return -2;
+
+    endpoint_t endpoint = p_topic_name[BASE64_LENGTH + 1] - '0';
+
+    if (endpoint >= SERVICE_BSP_ENDPOINTS)
+        return -3;
+
+    const char * p_suffix      = &p_topic_name[BASE64_LENGTH + 3];
+    uint16_t     suffix_length = name_length - (BASE64_LENGTH + 3);
+
+    service_type_t type;
+    for (type = info; type < type_none; type++)
     {
-        return &m_service_database[topic_id - 1];
+        if (   strlen(m_service_type_str[type]) == suffix_length
+            && 0 == memcmp(p_suffix, m_service_type_str[type], suffix_length))
+            break;
     }
-    else
+
+    if (type_none == type)
+        return -4;
+
+    // the gateway might change its mind (new session), the entry is updated
+    service_data_t service =
     {
-        return NULL;
-    }
+        .topic_id = topic_id,
+        .type     = type,
+        .endpoint = endpoint,
+    };
+
+    return database_add(&service);
 }
 
+service_data_t * service_pop_with_topic_id(uint16_t topic_id)
+{
+    const dispatch_entry_t * p_entry = service_dispatch_find(topic_id);
+
+    if (   NULL == p_entry
+        || dispatch_self != p_entry->kind)
+        return NULL;
+
+    return database_find(p_entry->self.endpoint, p_entry->self.type);
+}
@@ -21,21 +21,83 @@
 #define SERVICE_ENDPOINT_MAX         9
 
 /*
- * The easiest way to distinguish topics between self and external is the
- * topic ID which are returned by the broker and each one is assigned only
- * for the particular client (they are not broker wide)
- *
- * Endpoints multiplied by services indicates the max self topic ID
- * Atm. 8 * 5 = 40
+ * Endpoints multiplied by services indicates the number of self topics
+ * Atm. 8 * 5 = 40 (predefined topic IDs range). The topic IDs assigned by the
+ * gateway are dispatched with service_dispatch regardless of the range
  */
 #define SERVICE_SELF_TOPIC_ID_MAX    40
 
+/*
+ * The gateway assigns the normal topic IDs (REGACK, SUBACK, REGISTER) from 1
+ * upwards, the predefined ones start above them - both share the dispatch
+ * table, which is keyed on the topic ID alone
+ */
+#ifndef SERVICE_NORMAL_TOPIC_ID_MAX
+#define SERVICE_NORMAL_TOPIC_ID_MAX      0xEFFF
+#endif
+
+#ifndef SERVICE_PREDEFINED_TOPIC_BASE
+#define SERVICE_PREDEFINED_TOPIC_BASE    0xF000
+#endif
+
+#define SERVICE_PENDING_FLAG         (-6)
+#define SERVICE_BUSY_FLAG            (-7)
 #define SERVICE_RETRY_CNT_MAX_FLAG   (-8)
 #define SERVICE_ALL_REGISTERED_FLAG  (-9)
 
 #define SERVICE_MSG_OFF            "off"
 #define SERVICE_MSG_ON             "on"
 
+#define SERVICE_STR_INFO          "info"
+#define SERVICE_STR_TIME          "time"
+#define SERVICE_STR_PREC          "prec"
+#define SERVICE_STR_ONOFF         "onoff"
+#define SERVICE_STR_TEMPHUM       "temphum"
+#define SERVICE_STR_CONFIG_SUB    "config/sub"
+#define SERVICE_STR_CONFIG_UNSUB  "config/unsub"
+#define SERVICE_STR_CONFIG_LIST   "config/list"
+
+/*
+ * Topic suffixes of the self services ordered as service_type_t, each one
+ * prefixed with the string literal (shared with tools/predefined_topics.c)
+ */
+#define SERVICE_TYPE_STRINGS_PREFIXED(prefix)                                 \
+{                                                                             \
+    prefix SERVICE_STR_INFO,                                                  \
+    prefix SERVICE_STR_ONOFF,                                                 \
+    prefix SERVICE_STR_CONFIG_SUB,                                            \
+    prefix SERVICE_STR_CONFIG_UNSUB,                                          \
+    prefix SERVICE_STR_CONFIG_LIST                                            \
+}
+
+#define SERVICE_TYPE_STRINGS        SERVICE_TYPE_STRINGS_PREFIXED("")
+
+/*
+ * Predefined topic IDs mode - self topic IDs are derived from the endpoint
+ * and the service type, so no topic is registered or subscribed one by one
+ * (single '<id>/#' SUBSCRIBE) and the publishes carry TopicIdType
+ * predefined (QoS -1). The gateway has to be configured with the output of
+ * tools/predefined_topics (make -C tools predefined_topics). The IDs fit in
+ * SERVICE_PREDEFINED_TOPIC_BASE + 0..SERVICE_SELF_TOPIC_ID_MAX - 1
+ */
+#ifndef SERVICE_PREDEFINED_TOPICS
+#define SERVICE_PREDEFINED_TOPICS    0
+#endif
+
+#define SERVICE_PREDEFINED_TOPIC_ID(endpoint, type)                           \
+        ((uint16_t) (SERVICE_PREDEFINED_TOPIC_BASE                            \
+                     + (endpoint) * type_none + (type)))
+
+/*
+ * Wildcard subscription mode - a single '<id>/#' SUBSCRIBE replaces the
+ * subscriptions of all the self services. The gateway REGISTERs each topic
+ * before the first PUBLISH on it, the topic name is parsed once and the
+ * service is added to the database
+ */
+#ifndef SERVICE_WILDCARD_SUBSCRIPTION
+#define SERVICE_WILDCARD_SUBSCRIPTION    0
+#endif
+
 
 typedef enum {
     lightbulb = 0,
@@ -68,34 +130,101 @@ typedef struct {
     endpoint_t endpoint;
 } service_data_t;
 
+/*
+ * Owner of the slot which is not put to the database (i.e. external group),
+ * called with the topic ID from the SUBACK (0 for the UNSUBACK). is_acked is
+ * false if the retry limit was reached - the request is lost
+ */
+typedef int8_t (*service_owner_cb)(uint16_t topic_id, bool is_acked);
+
 
-int8_t create_self_services_init(void);
+/*
+ * Starts the creation of all self services from scratch (clean session)
+ */
+int8_t create_self_services_init(uint8_t gateway_id);
 
 /*
+ * Resumes the session - only services missing in the database are created
+ * Returns SERVICE_ALL_REGISTERED_FLAG if there is nothing to create
+ */
+int8_t create_self_services_resume(uint8_t gateway_id);
+
+/*
+ * Returns true if the gateway keeps the session the database was created with
+ */
+bool service_session_is_resumable(uint8_t gateway_id);
+
+/*
+ * Refills the window of self services being created
  * Returns SERVICE_ALL_REGISTERED_FLAG if finished
  */
 int8_t create_self_services_continue(void);
 
+/*
+ * Time elapsed between create_self_services_init() and the last SUBACK [ms]
+ * Returns 0 if the self services are not created yet
+ */
+uint32_t service_provisioning_time_ms(void);
+
+/*
+ * Topic IDs cache kept in flash - allows to skip the creation of self
+ * services after reboot if the gateway session is resumed
+ */
+bool service_cache_is_valid(uint8_t gateway_id);
+
+int8_t service_cache_store(uint8_t gateway_id);
+
+/*
+ * Returns index of the creation slot or negative error code
+ * (SERVICE_BUSY_FLAG if all SERVICE_CREATE_BUFFER_SIZE slots are taken)
+ */
 int8_t service_create(char * p_base_id,
                       endpoint_t endpoint,
                       service_type_t type);
 
-bool service_is_created(uint16_t * msg_id);
+bool service_is_created(uint8_t slot, uint16_t * msg_id);
+
+/*
+ * Switches only report their state, everything else is received by the device
+ */
+bool service_is_inbound(endpoint_t endpoint, service_type_t type);
 
-void service_destroy(void);
+void service_destroy(uint8_t slot);
 
-int8_t service_register(void);
-int8_t service_subscribe(void);
+/*
+ * The acknowledgements are resolved by comm_manager_inflight_resolve(). The
+ * REGACK/SUBACK puts the service to the database, unless the owner_cb is given
+ * (the slot is released before the owner is called). On timeout the message
+ * is resent after the backoff (comm_manager_backoff_ms) and
+ * SERVICE_RETRY_CNT_MAX_FLAG is returned if the retry counter reached
+ * DEFAULT_RETRANSMISSION_CNT
+ */
+int8_t service_register(uint8_t slot);
+int8_t service_subscribe(uint8_t slot, service_owner_cb owner_cb);
 
 /*
- * Returns SERVICE_RETRY_CNT_MAX_FLAG if retry counter
- * reached DEFAULT_RETRANSMISSION_CNT
+ * Sends the UNSUBSCRIBE of the slot topic, the UNSUBACK goes to the owner_cb
+ * (retried on timeout just like the SUBSCRIBE)
  */
-int8_t service_retry_subscribe(uint16_t msg_id);
-int8_t service_retry_register(uint16_t msg_id);
+int8_t service_unsubscribe(uint8_t slot, service_owner_cb owner_cb);
 
-int8_t service_subscribe_to_registered(uint16_t msg_id, uint16_t topic_id);
-int8_t service_insert_to_database(uint16_t msg_id, uint16_t topic_id);
+/*
+ * Returns the topic ID of the self service. Services which are not subscribed
+ * are registered on the first call - SERVICE_PENDING_FLAG is returned until
+ * the REGACK arrives
+ */
+int8_t service_topic_id_get(endpoint_t endpoint,
+                            service_type_t type,
+                            uint16_t * p_topic_id);
+
+/*
+ * Adds the self service with the topic ID assigned by the gateway
+ * (gateway-initiated REGISTER in the wildcard subscription mode)
+ * The name needs no terminator, name_length bounds all the compares
+ */
+int8_t service_learn_topic(uint16_t topic_id,
+                           const char * p_topic_name,
+                           uint16_t name_length);
 
 service_data_t * service_pop_with_topic_id(uint16_t topic_id);
 
@@ -0,0 +1,209 @@
+/*
+ * power_report.c
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: MSc Patryk Silkowski
+ *
+ * Host tool estimating the average current and the airtime of the node
+ * with the radio always on (RX_ON_WHEN_IDLE) and in the sleepy mode
+ * (COMM_SLEEP_MODE - Sleepy End Device and the MQTT-SN sleeping client).
+ * The sleep and poll timings are taken from comm_sleep.h and comm_poll.h
+ * (fast polling while the messages are exchanged), the currents are the
+ * nRF52840 datasheet values (DC/DC on, 0 dBm), so the result is an estimate
+ * to compare the modes, not a measurement.
+ *
+ * usage: power_report [<poll_period_ms> [<publishes_per_hour>]]
+ */
+
+/* GCC */
+#include <stdio.h>
+#include <stdlib.h>
+
+/* APP */
+#include "comm_poll.h"
+#include "comm_sleep.h"
+
+
+#define POLL_PERIOD_MS_DEFAULT  1000        // DEFAULT_POLL_PERIOD of main.c
+#define PUBLISHES_DEFAULT       60
+
+#define I_SLEEP_MA              0.0032      // System ON, RTC running, RAM retained
+#define I_RADIO_RX_MA           4.6
+#define I_RADIO_TX_MA           4.8
+#define I_CPU_MA                3.3
+
+#define PHY_US_PER_BYTE         32.0        // 250 kbps O-QPSK
+#define RADIO_RAMP_US           200.0       // rx/tx turnaround and the ramp up
+#define CPU_MS_PER_FRAME        1.0         // stack processing of the frame
+
+#define DATA_REQUEST_BYTES      18          // MAC command with PHY header
+#define ACK_BYTES               11
+#define MQTTSN_FRAME_BYTES      70          // 6LoWPAN + UDP + MQTT-SN message
+
+/*
+ * Messages of one wake up cycle: CONNECT, CONNACK, DISCONNECT(duration),
+ * DISCONNECT - every frame is acknowledged on the MAC layer
+ */
+#define WAKEUP_CYCLE_TX         2
+#define WAKEUP_CYCLE_RX         2
+
+#define BATTERY_MAH             2000.0      // 2xAA
+
+#define HOUR_MS                 3600000.0
+
+
+typedef struct {
+    double charge_mas;      // per hour [mA*s]
+    double airtime_ms;      // per hour
+    double awake_ms;        // radio on (or ready to receive) per hour
+} report_t;
+
+
+static double frame_ms(unsigned bytes)
+{
+    return (bytes * PHY_US_PER_BYTE + RADIO_RAMP_US) / 1000.0;
+}
+
+
+/*
+ * Frame sent and acknowledged (or received and acknowledged)
+ */
+static void frame_exchange(report_t * p_report, unsigned bytes, bool is_tx)
+{
+    double data_ms = frame_ms(bytes);
+    double ack_ms  = frame_ms(ACK_BYTES);
+
+    p_report->airtime_ms += data_ms + ack_ms;
+    p_report->charge_mas += (is_tx ? (data_ms * I_RADIO_TX_MA
+                                      + ack_ms * I_RADIO_RX_MA)
+                                   : (data_ms * I_RADIO_RX_MA
+                                      + ack_ms * I_RADIO_TX_MA)) / 1000.0;
+    p_report->charge_mas += CPU_MS_PER_FRAME * I_CPU_MA / 1000.0;
+}
+
+
+/*
+ * Publish and its PUBACK
+ */
+static void publishes(report_t * p_report, unsigned count)
+{
+    for (unsigned i = 0; i < count; i++)
+    {
+        frame_exchange(p_report, MQTTSN_FRAME_BYTES, true);
+        frame_exchange(p_report, MQTTSN_FRAME_BYTES, false);
+    }
+}
+
+
+static report_t report_rx_on(unsigned publishes_per_hour)
+{
+    report_t report = { 0 };
+
+    // the receiver is on all the time, the frames are on top of it
+    report.awake_ms   = HOUR_MS;
+    report.charge_mas = HOUR_MS * I_RADIO_RX_MA / 1000.0;
+
+    publishes(&report, publishes_per_hour);
+
+    return report;
+}
+
+
+static report_t report_sleepy(unsigned poll_period_ms,
+                              unsigned publishes_per_hour)
+{
+    report_t report = { 0 };
+
+    // the downlink messages wait for the data request - half of the fast
+    // period, then the client waits for the sleep with the RX period
+    double exchange_ms    = WAKEUP_CYCLE_RX * COMM_POLL_FAST_MS / 2.0;
+    double cycle_awake_ms = exchange_ms + COMM_SLEEP_IDLE_MS;
+    double cycle_ms       = COMM_SLEEP_DURATION_S * 1000.0
+                          - COMM_SLEEP_WAKEUP_MARGIN_MS
+                          + cycle_awake_ms;
+    double cycles         = HOUR_MS / cycle_ms;
+    double polls          = cycles * (exchange_ms / COMM_POLL_FAST_MS
+                                      + (double) COMM_SLEEP_IDLE_MS
+                                                        / COMM_POLL_RX_MS)
+                          + (HOUR_MS - cycles * cycle_awake_ms)
+                                                        / poll_period_ms;
+
+    // data request and the ack with the frame pending bit
+    for (unsigned long i = 0; i < (unsigned long) polls; i++)
+    {
+        frame_exchange(&report, DATA_REQUEST_BYTES, true);
+    }
+
+    for (unsigned long i = 0; i < (unsigned long) cycles; i++)
+    {
+        for (unsigned j = 0; j < WAKEUP_CYCLE_TX; j++)
+            frame_exchange(&report, MQTTSN_FRAME_BYTES, true);
+
+        for (unsigned j = 0; j < WAKEUP_CYCLE_RX; j++)
+            frame_exchange(&report, MQTTSN_FRAME_BYTES, false);
+    }
+
+    // the publishes are sent in the wake up cycles
+    publishes(&report, publishes_per_hour);
+
+    report.awake_ms    = report.airtime_ms;
+    report.charge_mas += (HOUR_MS - report.awake_ms) * I_SLEEP_MA / 1000.0;
+
+    return report;
+}
+
+
+static void report_print(const char * p_name, const report_t * p_report)
+{
+    double avg_ma  = p_report->charge_mas / (HOUR_MS / 1000.0);
+    double life_h  = BATTERY_MAH / avg_ma;
+
+    printf("%-8s %10.4f %14.1f %12.2f %10.1f\n",
+           p_name,
+           avg_ma,
+           p_report->airtime_ms / 1000.0,
+           100.0 * p_report->awake_ms / HOUR_MS,
+           life_h / 24.0);
+}
+
+
+int main(int argc, char *argv[])
+{
+    unsigned poll_period_ms     = POLL_PERIOD_MS_DEFAULT;
+    unsigned publishes_per_hour = PUBLISHES_DEFAULT;
+
+    if (argc > 3)
+    {
+        fprintf(stderr, "usage: %s [<poll_period_ms> [<publishes_per_hour>]]\n",
+                argv[0]);
+        return 1;
+    }
+
+    if (argc > 1)
+        poll_period_ms = (unsigned) strtoul(argv[1], NULL, 10);
+
+    if (argc > 2)
+        publishes_per_hour = (unsigned) strtoul(argv[2], NULL, 10);
+
+    if (0 == poll_period_ms)
+    {
+        fprintf(stderr, "poll period has to be greater than 0\n");
+        return 2;
+    }
+
+    printf("poll period %u ms, sleep %u s, %u publishes/h, battery %.0f mAh\n",
+           poll_period_ms,
+           COMM_SLEEP_DURATION_S,
+           publishes_per_hour,
+           BATTERY_MAH);
+    printf("%-8s %10s %14s %12s %10s\n",
+           "mode", "avg [mA]", "airtime [s/h]", "radio on [%]", "life [d]");
+
+    report_t rx_on  = report_rx_on(publishes_per_hour);
+    report_t sleepy = report_sleepy(poll_period_ms, publishes_per_hour);
+
+    report_print("rx_on", &rx_on);
+    report_print("sleepy", &sleepy);
+
+    return 0;
+}
@@ -0,0 +1,61 @@
+/*
+ * predefined_topics.c
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: MSc Patryk Silkowski
+ *
+ * Host tool printing the predefined topics of the device in the format of
+ * the MQTT-SN gateway predefined topic file (ClientID,TopicName,TopicID).
+ * Topic names and IDs are taken from the firmware's service table, so the
+ * output matches the firmware built with SERVICE_PREDEFINED_TOPICS.
+ *
+ * usage: predefined_topics <device_id> [<device_id> ...]
+ *        (device ID is the base64 ID printed by the device, e.g. s4t0dOpl8i2f)
+ */
+
+/* GCC */
+#include <stdio.h>
+#include <string.h>
+
+/* APP */
+#include "service_bsp.h"
+#include "service_setup.h"
+
+
+static const char * const m_service_type_str[type_none] = SERVICE_TYPE_STRINGS;
+
+
+int main(int argc, char *argv[])
+{
+    if (argc < 2)
+    {
+        fprintf(stderr, "usage: %s <device_id> [<device_id> ...]\n", argv[0]);
+        return 1;
+    }
+
+    for (int i = 1; i < argc; i++)
+    {
+        const char * p_id = argv[i];
+
+        if (strlen(p_id) != BASE64_LENGTH)
+        {
+            fprintf(stderr, "%s: invalid device ID\n", p_id);
+            return 2;
+        }
+
+        for (endpoint_t endpoint = 0; endpoint < SERVICE_BSP_ENDPOINTS; endpoint++)
+        {
+            for (service_type_t type = info; type < type_none; type++)
+            {
+                printf("%s,%s/%d/%s,%d\n",
+                       p_id,
+                       p_id,
+                       endpoint,
+                       m_service_type_str[type],
+                       SERVICE_PREDEFINED_TOPIC_ID(endpoint, type));
+            }
+        }
+    }
+
+    return 0;
+}
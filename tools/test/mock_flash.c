@@ -0,0 +1,169 @@
+/*
+ * mock_flash.c
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: MSc Patryk Silkowski
+ */
+
+#include "mock_flash.h"
+
+/* GCC */
+#include <stddef.h>
+#include <string.h>
+
+/* SDK */
+#include "crc16.h"
+#include "nrf_fstorage.h"
+#include "nrf_fstorage_nvmc.h"
+
+
+#define MOCK_FLASH_SIZE         0x100000        // nRF52840
+#define MOCK_FLASH_PAGE_SIZE    0x1000
+
+
+nrf_fstorage_api_t nrf_fstorage_nvmc;
+
+static uint8_t  m_flash[MOCK_FLASH_SIZE];
+static uint32_t m_erase_cnt;
+static uint32_t m_write_cnt;
+
+
+static bool is_in_range(nrf_fstorage_t const * p_fs, uint32_t addr, uint32_t len)
+{
+    return    addr >= p_fs->start_addr
+           && addr + len - 1 <= p_fs->end_addr
+           && addr + len <= MOCK_FLASH_SIZE;
+}
+
+
+static void evt_send(nrf_fstorage_t const * p_fs,
+                     nrf_fstorage_evt_id_t id,
+                     uint32_t addr,
+                     void const * p_src,
+                     uint32_t len,
+                     void * p_param)
+{
+    nrf_fstorage_evt_t evt =
+    {
+        .id      = id,
+        .result  = NRF_SUCCESS,
+        .addr    = addr,
+        .p_src   = p_src,
+        .len     = len,
+        .p_param = p_param,
+    };
+
+    if (p_fs->evt_handler)
+        p_fs->evt_handler(&evt);
+}
+
+
+ret_code_t nrf_fstorage_init(nrf_fstorage_t * p_fs,
+                             nrf_fstorage_api_t * p_api,
+                             void * p_param)
+{
+    (void) p_param;
+
+    p_fs->p_api = p_api;
+    return NRF_SUCCESS;
+}
+
+
+ret_code_t nrf_fstorage_read(nrf_fstorage_t const * p_fs,
+                             uint32_t src,
+                             void * p_dest,
+                             uint32_t len)
+{
+    if (false == is_in_range(p_fs, src, len))
+        return NRF_ERROR_INVALID_ADDR;
+
+    memcpy(p_dest, &m_flash[src], len);
+    return NRF_SUCCESS;
+}
+
+
+ret_code_t nrf_fstorage_write(nrf_fstorage_t const * p_fs,
+                              uint32_t dest,
+                              void const * p_src,
+                              uint32_t len,
+                              void * p_param)
+{
+    if (   false == is_in_range(p_fs, dest, len)
+        || (dest | len) & 3)
+        return NRF_ERROR_INVALID_ADDR;
+
+    // the write only clears the bits, the page has to be erased before
+    for (uint32_t i = 0; i < len; i++)
+    {
+        m_flash[dest + i] &= ((uint8_t const *) p_src)[i];
+    }
+
+    m_write_cnt++;
+    evt_send(p_fs, NRF_FSTORAGE_EVT_WRITE_RESULT, dest, p_src, len, p_param);
+    return NRF_SUCCESS;
+}
+
+
+ret_code_t nrf_fstorage_erase(nrf_fstorage_t const * p_fs,
+                              uint32_t page_addr,
+                              uint32_t len,
+                              void * p_param)
+{
+    uint32_t size = len * MOCK_FLASH_PAGE_SIZE;
+
+    if (   false == is_in_range(p_fs, page_addr, size)
+        || page_addr % MOCK_FLASH_PAGE_SIZE)
+        return NRF_ERROR_INVALID_ADDR;
+
+    memset(&m_flash[page_addr], 0xFF, size);
+
+    m_erase_cnt += len;
+    evt_send(p_fs, NRF_FSTORAGE_EVT_ERASE_RESULT, page_addr, NULL, len, p_param);
+    return NRF_SUCCESS;
+}
+
+
+/* CRC-16-CCITT, the same as components/libraries/crc16 of the SDK */
+uint16_t crc16_compute(uint8_t const * p_data, uint32_t size, uint16_t const * p_crc)
+{
+    uint16_t crc = (NULL == p_crc) ? 0xFFFF : *p_crc;
+
+    for (uint32_t i = 0; i < size; i++)
+    {
+        crc  = (uint8_t) (crc >> 8) | (crc << 8);
+        crc ^= p_data[i];
+        crc ^= (uint8_t) (crc & 0xFF) >> 4;
+        crc ^= (crc << 8) << 4;
+        crc ^= ((crc & 0xFF) << 4) << 1;
+    }
+
+    return crc;
+}
+
+
+void mock_flash_reset(void)
+{
+    memset(m_flash, 0xFF, sizeof(m_flash));
+
+    m_erase_cnt = 0;
+    m_write_cnt = 0;
+}
+
+
+uint32_t mock_flash_erase_cnt(void)
+{
+    return m_erase_cnt;
+}
+
+
+uint32_t mock_flash_write_cnt(void)
+{
+    return m_write_cnt;
+}
+
+
+void mock_flash_corrupt(uint32_t addr, uint8_t mask)
+{
+    if (addr < MOCK_FLASH_SIZE)
+        m_flash[addr] ^= mask;
+}
@@ -0,0 +1,35 @@
+/*
+ * mock_flash.h
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: MSc Patryk Silkowski
+ *
+ * Host flash backend of nrf_fstorage - the flash is kept in RAM, the erase
+ * and write are done at once and the counters allow to check the wear.
+ */
+
+#ifndef TOOLS_TEST_MOCK_FLASH_H_
+#define TOOLS_TEST_MOCK_FLASH_H_
+
+/* GCC */
+#include <stdint.h>
+
+
+/**@brief Function for erasing the whole mock flash and clearing the counters.
+ */
+void mock_flash_reset(void);
+
+/**@brief Number of the page erases since the reset.
+ */
+uint32_t mock_flash_erase_cnt(void);
+
+/**@brief Number of the writes since the reset.
+ */
+uint32_t mock_flash_write_cnt(void);
+
+/**@brief Function for flipping the bits of the byte (simulates corruption).
+ */
+void mock_flash_corrupt(uint32_t addr, uint8_t mask);
+
+
+#endif /* TOOLS_TEST_MOCK_FLASH_H_ */
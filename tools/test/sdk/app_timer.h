@@ -0,0 +1,53 @@
+/*
+ * app_timer.h
+ *
+ * Host stand-in of the nRF5 SDK header - only what the tested modules use.
+ * The functions are provided by the test.
+ */
+
+#ifndef TEST_APP_TIMER_H_
+#define TEST_APP_TIMER_H_
+
+#include <stdint.h>
+
+#include "sdk_errors.h"
+
+#define APP_TIMER_CLOCK_FREQ            32768
+#define APP_TIMER_CONFIG_RTC_FREQUENCY  0
+#define APP_TIMER_MIN_TIMEOUT_TICKS     5
+#define APP_TIMER_TICKS(MS)                                         \
+            ((uint32_t) (((uint64_t) (MS) * APP_TIMER_CLOCK_FREQ)    \
+                         / ((APP_TIMER_CONFIG_RTC_FREQUENCY + 1) * 1000)))
+
+typedef struct {
+    uint32_t unused;
+} app_timer_t;
+
+typedef app_timer_t * app_timer_id_t;
+
+#define APP_TIMER_DEF(TIMER_ID)                                     \
+    static app_timer_t TIMER_ID##_data;                             \
+    static const app_timer_id_t TIMER_ID = &TIMER_ID##_data
+
+typedef void (*app_timer_timeout_handler_t)(void * p_context);
+
+typedef enum {
+    APP_TIMER_MODE_SINGLE_SHOT,
+    APP_TIMER_MODE_REPEATED
+} app_timer_mode_t;
+
+ret_code_t app_timer_create(app_timer_id_t const * p_timer_id,
+                            app_timer_mode_t mode,
+                            app_timer_timeout_handler_t timeout_handler);
+
+ret_code_t app_timer_start(app_timer_id_t timer_id,
+                           uint32_t timeout_ticks,
+                           void * p_context);
+
+ret_code_t app_timer_stop(app_timer_id_t timer_id);
+
+uint32_t app_timer_cnt_get(void);
+
+uint32_t app_timer_cnt_diff_compute(uint32_t ticks_to, uint32_t ticks_from);
+
+#endif /* TEST_APP_TIMER_H_ */
@@ -0,0 +1,15 @@
+/*
+ * app_util.h
+ *
+ * Host stand-in of the nRF5 SDK header - only what the tested modules use.
+ */
+
+#ifndef TEST_APP_UTIL_H_
+#define TEST_APP_UTIL_H_
+
+#define STATIC_ASSERT(EXPR)     _Static_assert(EXPR, #EXPR)
+
+#define MIN(a, b)               ((a) < (b) ? (a) : (b))
+#define MAX(a, b)               ((a) < (b) ? (b) : (a))
+
+#endif /* TEST_APP_UTIL_H_ */
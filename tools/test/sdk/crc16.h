@@ -0,0 +1,14 @@
+/*
+ * crc16.h
+ *
+ * Host stand-in of the nRF5 SDK header, implemented in mock_flash.c.
+ */
+
+#ifndef TEST_CRC16_H_
+#define TEST_CRC16_H_
+
+#include <stdint.h>
+
+uint16_t crc16_compute(uint8_t const * p_data, uint32_t size, uint16_t const * p_crc);
+
+#endif /* TEST_CRC16_H_ */
@@ -0,0 +1,97 @@
+/*
+ * mqttsn_client.h
+ *
+ * Host stand-in of the nRF5 SDK header - only the types the tested modules
+ * use, the client functions are provided by the test.
+ */
+
+#ifndef TEST_MQTTSN_CLIENT_H_
+#define TEST_MQTTSN_CLIENT_H_
+
+#include <stdint.h>
+
+#include "sdk_errors.h"
+
+#define MQTTSN_CLIENT_ID_MAX_LENGTH     23
+
+typedef struct {
+    uint8_t  addr[16];
+    uint16_t port_number;
+} mqttsn_remote_t;
+
+typedef struct {
+    uint16_t        alive_duration;
+    uint8_t         clean_session;
+    uint8_t         will_flag;
+    uint8_t         p_client_id[MQTTSN_CLIENT_ID_MAX_LENGTH];
+    uint8_t         client_id_len;
+} mqttsn_connect_opt_t;
+
+typedef struct {
+    const uint8_t * p_topic_name;
+    uint16_t        topic_id;
+} mqttsn_topic_t;
+
+typedef struct {
+    mqttsn_topic_t  topic;
+    uint16_t        id;
+    uint8_t         retransmission_cnt;
+    uint8_t         dup;
+    uint8_t         qos;
+    uint8_t         retain;
+    uint8_t *       p_data;
+    uint16_t        len;
+    uint32_t        timeout;
+} mqttsn_packet_t;
+
+typedef enum {
+    MQTTSN_ERROR_REJECTED_CONGESTION,
+    MQTTSN_ERROR_TIMEOUT
+} mqttsn_error_t;
+
+typedef enum {
+    MQTTSN_PACKET_REGACK   = 0x0B,
+    MQTTSN_PACKET_PUBACK   = 0x0D,
+    MQTTSN_PACKET_SUBACK   = 0x13,
+    MQTTSN_PACKET_UNSUBACK = 0x15
+} mqttsn_packet_types_t;
+
+typedef struct {
+    mqttsn_error_t          error;
+    mqttsn_packet_types_t   msg_type;
+    uint16_t                msg_id;
+} mqttsn_event_error_t;
+
+typedef struct {
+    mqttsn_packet_t packet;
+    uint8_t *       p_payload;
+} mqttsn_event_published_t;
+
+typedef struct {
+    mqttsn_packet_t packet;
+} mqttsn_event_registered_t;
+
+typedef struct {
+    mqttsn_packet_t packet;
+} mqttsn_event_subscribed_t;
+
+typedef enum {
+    MQTTSN_EVENT_REGISTERED,
+    MQTTSN_EVENT_PUBLISHED,
+    MQTTSN_EVENT_SUBSCRIBED,
+    MQTTSN_EVENT_UNSUBSCRIBED,
+    MQTTSN_EVENT_RECEIVED,
+    MQTTSN_EVENT_TIMEOUT
+} mqttsn_event_id_t;
+
+typedef struct {
+    mqttsn_event_id_t event_id;
+    union {
+        mqttsn_event_error_t        error;
+        mqttsn_event_published_t    published;
+        mqttsn_event_registered_t   registered;
+        mqttsn_event_subscribed_t   subscribed;
+    } event_data;
+} mqttsn_event_t;
+
+#endif /* TEST_MQTTSN_CLIENT_H_ */
@@ -0,0 +1,23 @@
+/*
+ * nrf52840.h
+ *
+ * Host stand-in of the device header - the FICR holds a fixed device address.
+ */
+
+#ifndef TEST_NRF52840_H_
+#define TEST_NRF52840_H_
+
+#include <stdint.h>
+
+typedef struct {
+    uint32_t DEVICEADDR[2];
+} NRF_FICR_Type;
+
+static const NRF_FICR_Type m_host_ficr =
+{
+    .DEVICEADDR = { 0x6E1B74B3, 0x9F2D },
+};
+
+#define NRF_FICR    (&m_host_ficr)
+
+#endif /* TEST_NRF52840_H_ */
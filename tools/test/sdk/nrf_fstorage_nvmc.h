@@ -0,0 +1,14 @@
+/*
+ * nrf_fstorage_nvmc.h
+ *
+ * Host stand-in of the nRF5 SDK header, implemented in mock_flash.c.
+ */
+
+#ifndef TEST_NRF_FSTORAGE_NVMC_H_
+#define TEST_NRF_FSTORAGE_NVMC_H_
+
+#include "nrf_fstorage.h"
+
+extern nrf_fstorage_api_t nrf_fstorage_nvmc;
+
+#endif /* TEST_NRF_FSTORAGE_NVMC_H_ */
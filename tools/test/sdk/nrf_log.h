@@ -0,0 +1,20 @@
+/*
+ * nrf_log.h
+ *
+ * Host stand-in of the nRF5 SDK header - the logs are dropped.
+ */
+
+#ifndef TEST_NRF_LOG_H_
+#define TEST_NRF_LOG_H_
+
+static inline void nrf_log_host(const char * p_format, ...)
+{
+    (void) p_format;
+}
+
+#define NRF_LOG_ERROR(...)      nrf_log_host(__VA_ARGS__)
+#define NRF_LOG_WARNING(...)    nrf_log_host(__VA_ARGS__)
+#define NRF_LOG_INFO(...)       nrf_log_host(__VA_ARGS__)
+#define NRF_LOG_DEBUG(...)      nrf_log_host(__VA_ARGS__)
+
+#endif /* TEST_NRF_LOG_H_ */
@@ -0,0 +1,19 @@
+/*
+ * sdk_errors.h
+ *
+ * Host stand-in of the nRF5 SDK header - only what the tested modules use.
+ */
+
+#ifndef TEST_SDK_ERRORS_H_
+#define TEST_SDK_ERRORS_H_
+
+#include <stdint.h>
+
+typedef uint32_t ret_code_t;
+
+#define NRF_SUCCESS             0
+#define NRF_ERROR_NO_MEM        4
+#define NRF_ERROR_INVALID_ADDR  16
+#define NRF_ERROR_BUSY          17
+
+#endif /* TEST_SDK_ERRORS_H_ */
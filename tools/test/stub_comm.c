@@ -0,0 +1,104 @@
+/*
+ * stub_comm.c
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: MSc Patryk Silkowski
+ */
+
+#include "stub_comm.h"
+
+/* SDK */
+#include "app_timer.h"
+
+/* APP */
+#include "comm_manager.h"
+
+
+static unsigned m_requests_sent;
+
+
+int8_t comm_manager_topic_register(char * p_topic_name,
+                                   uint16_t * msg_id,
+                                   comm_manager_ack_cb owner_cb,
+                                   void * p_context)
+{
+    m_requests_sent++;
+    return -1;
+}
+
+int8_t comm_manager_topic_subscribe(char * p_topic_name,
+                                    uint16_t * msg_id,
+                                    comm_manager_ack_cb owner_cb,
+                                    void * p_context)
+{
+    m_requests_sent++;
+    return -1;
+}
+
+int8_t comm_manager_topic_unsubscribe(char * p_topic_name,
+                                      uint16_t * msg_id,
+                                      comm_manager_ack_cb owner_cb,
+                                      void * p_context)
+{
+    m_requests_sent++;
+    return -1;
+}
+
+int8_t comm_manager_publish_stream(uint16_t topic_id,
+                                   uint8_t const * p_data,
+                                   uint16_t data_len,
+                                   comm_manager_ack_cb owner_cb,
+                                   void * p_context)
+{
+    m_requests_sent++;
+    return -1;
+}
+
+void comm_manager_rtt_sample(uint32_t rtt_ms)
+{
+}
+
+uint32_t comm_manager_backoff_ms(uint8_t attempt, bool is_congestion)
+{
+    return 0;
+}
+
+ret_code_t app_timer_create(app_timer_id_t const * p_timer_id,
+                            app_timer_mode_t mode,
+                            app_timer_timeout_handler_t timeout_handler)
+{
+    return NRF_SUCCESS;
+}
+
+ret_code_t app_timer_start(app_timer_id_t timer_id,
+                           uint32_t timeout_ticks,
+                           void * p_context)
+{
+    return NRF_SUCCESS;
+}
+
+ret_code_t app_timer_stop(app_timer_id_t timer_id)
+{
+    return NRF_SUCCESS;
+}
+
+uint32_t app_timer_cnt_get(void)
+{
+    return 0;
+}
+
+uint32_t app_timer_cnt_diff_compute(uint32_t ticks_to, uint32_t ticks_from)
+{
+    return ticks_to - ticks_from;
+}
+
+
+void comm_manager_retry_sent(void)
+{
+}
+
+
+unsigned stub_requests_sent(void)
+{
+    return m_requests_sent;
+}
@@ -0,0 +1,20 @@
+/*
+ * stub_comm.h
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: MSc Patryk Silkowski
+ *
+ * Stubs of comm_manager and app_timer for the host tests of the service
+ * modules - nothing is sent, the requests fail and are only counted.
+ */
+
+#ifndef TOOLS_TEST_STUB_COMM_H_
+#define TOOLS_TEST_STUB_COMM_H_
+
+
+/**@brief Number of the REGISTER/SUBSCRIBE/UNSUBSCRIBE/PUBLISH requests.
+ */
+unsigned stub_requests_sent(void);
+
+
+#endif /* TOOLS_TEST_STUB_COMM_H_ */
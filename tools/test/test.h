@@ -0,0 +1,37 @@
+/*
+ * test.h
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: MSc Patryk Silkowski
+ *
+ * Minimal checks of the host tests - the failed check is printed and the
+ * test returns non-zero from main (TEST_RESULT).
+ */
+
+#ifndef TOOLS_TEST_TEST_H_
+#define TOOLS_TEST_TEST_H_
+
+/* GCC */
+#include <stdio.h>
+
+
+static unsigned m_test_checks;
+static unsigned m_test_failures;
+
+#define TEST_CHECK(EXPR)                                                    \
+    do {                                                                    \
+        m_test_checks++;                                                    \
+        if (!(EXPR))                                                        \
+        {                                                                   \
+            m_test_failures++;                                              \
+            printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #EXPR); \
+        }                                                                   \
+    } while (0)
+
+#define TEST_RESULT(NAME)                                                   \
+    (printf("%s: %u checks, %u failed\n",                                   \
+            NAME, m_test_checks, m_test_failures),                          \
+     m_test_failures ? 1 : 0)
+
+
+#endif /* TOOLS_TEST_TEST_H_ */
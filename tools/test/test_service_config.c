@@ -0,0 +1,630 @@
+/*
+ * test_service_config.c
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: MSc Patryk Silkowski
+ *
+ * Host test of the ext groups (service_config.c). The module is included to
+ * reach the name index and the subscription lists. The creation slot of
+ * service_setup is stubbed here, so the SUBACK/UNSUBACK are delivered right
+ * after the request. The groups are joined and left in random order and
+ * compared with a reference model, the benchmark prints the cost of the name
+ * lookup against the linear scan up to the full EXT_TOPIC_LIMIT.
+ *
+ * The test is built at the default EXT_TOPIC_LIMIT and at the larger one
+ * (-DEXT_TOPIC_LIMIT, -DEXT_NAME_INDEX_SIZE), the benchmark fills the groups
+ * directly - the subscription lists do not hold more than
+ * SERVICE_BSP_ENDPOINTS * EXT_SUB_LIMIT_PER_ENDPOINT members.
+ *
+ * usage: test_service_config [<seed>]
+ */
+
+/* GCC */
+#include <stdlib.h>
+#include <time.h>
+
+/* APP */
+#include "service_config.c"
+
+/* TEST */
+#include "stub_comm.h"
+#include "test.h"
+
+
+#define NAME_POOL_SIZE          (EXT_TOPIC_LIMIT + 8)   // the limit is reached
+#define NAME_IDS                (NAME_POOL_SIZE / 3)    // endpoints share the ID
+#define RANDOM_STEPS            20000
+#define BENCH_ROUNDS            200000
+
+
+static uint32_t m_rand_state = 1;
+
+static char           m_names[NAME_POOL_SIZE][EXT_ENDPOINT_LENGTH + 1];
+static ext_endpoint_t m_packed[NAME_POOL_SIZE];
+
+// reference model - members of each name, the lists in the join order
+static endpoint_mask_t m_members[NAME_POOL_SIZE];
+static uint8_t         m_list[SERVICE_BSP_ENDPOINTS][EXT_SUB_LIMIT_PER_ENDPOINT];
+static uint8_t         m_list_cnt[SERVICE_BSP_ENDPOINTS];
+static uint16_t        m_group_cnt;
+
+// creation slot of service_setup (one is enough, the acks come at once)
+static bool             m_slot_is_busy;
+static service_owner_cb m_owner_cb;
+static unsigned         m_subscribes;
+static uint16_t         m_next_topic_id = 100;
+
+
+static uint32_t test_rand(void)
+{
+    // xorshift32
+    m_rand_state ^= m_rand_state << 13;
+    m_rand_state ^= m_rand_state >> 17;
+    m_rand_state ^= m_rand_state << 5;
+
+    return m_rand_state;
+}
+
+
+/***************************************************************************************************
+ * @section service_setup stubs
+ **************************************************************************************************/
+
+int8_t service_create(char * p_base_id,
+                      endpoint_t endpoint,
+                      service_type_t type)
+{
+    if (m_slot_is_busy)
+        return SERVICE_BUSY_FLAG;
+
+    m_slot_is_busy = true;
+    return 0;
+}
+
+void service_destroy(uint8_t slot)
+{
+    m_slot_is_busy = false;
+    m_owner_cb     = NULL;
+}
+
+int8_t service_subscribe(uint8_t slot, service_owner_cb owner_cb)
+{
+    m_owner_cb = owner_cb;
+    m_subscribes++;
+    return 0;
+}
+
+int8_t service_unsubscribe(uint8_t slot, service_owner_cb owner_cb)
+{
+    m_owner_cb = owner_cb;
+    return 0;
+}
+
+
+/*
+ * Acknowledges the requests until none is left (the UNSUBACK sends the next
+ * UNSUBSCRIBE of the queue), the slot is released before the owner is called
+ */
+static void acks_flush(void)
+{
+    while (m_slot_is_busy)
+    {
+        service_owner_cb owner_cb = m_owner_cb;
+
+        service_destroy(0);
+        TEST_CHECK(0 == owner_cb(m_next_topic_id++, true));
+
+        if (0 == m_next_topic_id)
+            m_next_topic_id = 100;
+    }
+}
+
+
+/***************************************************************************************************
+ * @section Model
+ **************************************************************************************************/
+
+/*
+ * Names of the pool - NAME_IDS IDs (some with the base64 padding) with the
+ * different endpoint numbers, so the packed names differ in a byte or two
+ */
+static void names_init(void)
+{
+    uint8_t id[NAME_IDS][EXT_ID_SIZE];
+
+    for (uint16_t i = 0; i < NAME_IDS; i++)
+    {
+        for (uint8_t j = 0; j < EXT_ID_SIZE; j++)
+            id[i][j] = (uint8_t) test_rand();
+    }
+
+    for (uint16_t i = 0; i < NAME_POOL_SIZE; i++)
+    {
+        uint16_t id_idx  = i % NAME_IDS;
+        uint8_t  padding = (0 == id_idx % 4) ? 2 : 0;
+        size_t   length;
+
+        mbedtls_base64_encode((unsigned char *) m_names[i],
+                              BASE64_LENGTH + 1,
+                              &length,
+                              id[id_idx],
+                              EXT_ID_SIZE - padding);
+
+        snprintf(&m_names[i][BASE64_LENGTH],
+                 sizeof(m_names[i]) - BASE64_LENGTH,
+                 "/%d",
+                 (i / NAME_IDS) % (SERVICE_ENDPOINT_MAX + 1));
+
+        uint16_t name_length = EXT_ENDPOINT_LENGTH;
+
+        TEST_CHECK(is_ext_endpoint_name_valid(m_names[i],
+                                              &name_length,
+                                              &m_packed[i]));
+    }
+}
+
+
+static void model_reset(void)
+{
+    memset(m_members, 0, sizeof(m_members));
+    memset(m_list_cnt, 0, sizeof(m_list_cnt));
+    m_group_cnt = 0;
+
+    memset(&m_ext_sub_temp_s, 0, sizeof(m_ext_sub_temp_s));
+    memset(m_sub_list_arr, 0, sizeof(m_sub_list_arr));
+    m_ext_topics_cnt = 0;
+    m_unsub_cnt      = 0;
+
+    service_dispatch_clear(dispatch_ext);
+    service_config_init();
+}
+
+
+static int8_t config_subscribe(endpoint_t endpoint, uint16_t name)
+{
+    int8_t err_code = service_config_subscribe(endpoint,
+                                               (uint8_t *) m_names[name],
+                                               EXT_ENDPOINT_LENGTH);
+    acks_flush();
+    return err_code;
+}
+
+
+// the SUBACK is left to the test
+static int8_t config_subscribe_sent(endpoint_t endpoint, uint16_t name)
+{
+    return service_config_subscribe(endpoint,
+                                    (uint8_t *) m_names[name],
+                                    EXT_ENDPOINT_LENGTH);
+}
+
+
+static int8_t config_unsubscribe(endpoint_t endpoint, uint16_t name)
+{
+    int8_t err_code = service_config_unsubscribe(endpoint,
+                                                 (uint8_t *) m_names[name],
+                                                 EXT_ENDPOINT_LENGTH);
+    acks_flush();
+    return err_code;
+}
+
+
+static int8_t model_subscribe(endpoint_t endpoint, uint16_t name)
+{
+    if (m_members[name] & (1 << endpoint))
+        return -3;
+
+    if (m_members[name])
+    {
+        if (m_list_cnt[endpoint] >= EXT_SUB_LIMIT_PER_ENDPOINT)
+            return -11;
+    }
+    else if (m_group_cnt >= EXT_TOPIC_LIMIT)
+        return -9;
+    else if (m_list_cnt[endpoint] >= EXT_SUB_LIMIT_PER_ENDPOINT)
+        return -11;
+    else
+        m_group_cnt++;
+
+    m_members[name] |= 1 << endpoint;
+    m_list[endpoint][m_list_cnt[endpoint]++] = name;
+    return 0;
+}
+
+
+static int8_t model_unsubscribe(endpoint_t endpoint, uint16_t name)
+{
+    if (0 == m_members[name])
+        return -3;
+
+    if (0 == (m_members[name] & (1 << endpoint)))
+        return -4;
+
+    m_members[name] &= ~(1 << endpoint);
+
+    if (0 == m_members[name])
+        m_group_cnt--;
+
+    for (uint8_t i = 0; i < m_list_cnt[endpoint]; i++)
+    {
+        if (name != m_list[endpoint][i])
+            continue;
+
+        m_list_cnt[endpoint]--;
+        memmove(&m_list[endpoint][i],
+                &m_list[endpoint][i + 1],
+                m_list_cnt[endpoint] - i);
+        break;
+    }
+
+    return 0;
+}
+
+
+/*
+ * Every name is found (or not) as the model says, the index holds each
+ * group once, the groups are dispatched with their index and the lists
+ * keep the join order
+ */
+static bool groups_are_consistent(void)
+{
+    if (m_group_cnt != m_ext_topics_cnt)
+        return false;
+
+    for (uint16_t i = 0; i < NAME_POOL_SIZE; i++)
+    {
+        ext_sub_topic_t * p_ext_topic = is_ext_topic_subscribed(&m_packed[i]);
+
+        if (NULL == p_ext_topic)
+        {
+            if (m_members[i])
+                return false;
+
+            continue;
+        }
+
+        uint8_t                  ext_index = (uint8_t) (p_ext_topic - m_ext_topics);
+        const dispatch_entry_t * p_entry   = service_dispatch_find(p_ext_topic->topic_id);
+
+        if (   ext_index >= m_ext_topics_cnt
+            || m_members[i] != p_ext_topic->endpoints
+            || NULL == p_entry
+            || dispatch_ext != p_entry->kind
+            || ext_index != p_entry->ext_index)
+            return false;
+    }
+
+    uint16_t indexed = 0;
+
+    for (uint16_t i = 0; i < EXT_NAME_INDEX_SIZE; i++)
+    {
+        if (EXT_NAME_INDEX_EMPTY == m_name_index[i])
+            continue;
+
+        if (m_name_index[i] >= m_ext_topics_cnt)
+            return false;
+
+        indexed++;
+    }
+
+    if (indexed != m_ext_topics_cnt)
+        return false;
+
+    for (endpoint_t endp = 0; endp < SERVICE_BSP_ENDPOINTS; endp++)
+    {
+        if (m_list_cnt[endp] != m_sub_list_arr[endp].sub_counter)
+            return false;
+
+        for (uint8_t i = 0; i < m_list_cnt[endp]; i++)
+        {
+            uint8_t ext_index = m_sub_list_arr[endp].ext_index[i];
+
+            if (   ext_index >= m_ext_topics_cnt
+                || memcmp(&m_packed[m_list[endp][i]],
+                          &m_ext_topics[ext_index].ext_endpoint,
+                          sizeof(ext_endpoint_t)))
+                return false;
+        }
+    }
+
+    return true;
+}
+
+
+/***************************************************************************************************
+ * @section Tests
+ **************************************************************************************************/
+
+static void test_random(void)
+{
+    model_reset();
+
+    for (uint32_t step = 0; step < RANDOM_STEPS; step++)
+    {
+        endpoint_t endpoint = test_rand() % SERVICE_BSP_ENDPOINTS;
+        uint16_t   name     = test_rand() % NAME_POOL_SIZE;
+
+        // more joins than leaves, so the limits are reached
+        if (test_rand() % 8 < 5)
+            TEST_CHECK(model_subscribe(endpoint, name) == config_subscribe(endpoint, name));
+        else
+            TEST_CHECK(model_unsubscribe(endpoint, name) == config_unsubscribe(endpoint, name));
+
+        TEST_CHECK(groups_are_consistent());
+    }
+}
+
+
+/*
+ * The removed group is replaced by the last one - its name, topic ID and
+ * list entries follow it
+ */
+static void test_remove_swap(void)
+{
+    model_reset();
+
+    for (uint16_t name = 0; name < 3; name++)
+    {
+        TEST_CHECK(0 == model_subscribe(name, name));
+        TEST_CHECK(0 == config_subscribe(name, name));
+    }
+
+    TEST_CHECK(0 == model_subscribe(0, 2));
+    TEST_CHECK(0 == config_subscribe(0, 2));
+
+    uint16_t topic_id = m_ext_topics[2].topic_id;
+
+    TEST_CHECK(0 == model_unsubscribe(0, 0));
+    TEST_CHECK(0 == config_unsubscribe(0, 0));
+
+    TEST_CHECK(2 == m_ext_topics_cnt);
+    TEST_CHECK(NULL == is_ext_topic_subscribed(&m_packed[0]));
+    TEST_CHECK(&m_ext_topics[0] == is_ext_topic_subscribed(&m_packed[2]));
+    TEST_CHECK(topic_id == m_ext_topics[0].topic_id);
+    TEST_CHECK(0 == service_dispatch_find(topic_id)->ext_index);
+    TEST_CHECK(0 == m_sub_list_arr[0].ext_index[0]);
+    TEST_CHECK(0 == m_sub_list_arr[2].ext_index[0]);
+    TEST_CHECK(groups_are_consistent());
+
+    // the last group itself
+    TEST_CHECK(0 == model_unsubscribe(1, 1));
+    TEST_CHECK(0 == config_unsubscribe(1, 1));
+    TEST_CHECK(NULL == is_ext_topic_subscribed(&m_packed[1]));
+    TEST_CHECK(groups_are_consistent());
+}
+
+
+/*
+ * The full subscription list leaves the group and the gateway untouched
+ */
+static void test_sub_list_full(void)
+{
+    model_reset();
+
+    for (uint16_t name = 0; name < EXT_SUB_LIMIT_PER_ENDPOINT; name++)
+    {
+        TEST_CHECK(0 == model_subscribe(0, name));
+        TEST_CHECK(0 == config_subscribe(0, name));
+    }
+
+    // the new group - no SUBSCRIBE
+    unsigned subscribes = m_subscribes;
+
+    TEST_CHECK(-11 == config_subscribe(0, EXT_SUB_LIMIT_PER_ENDPOINT));
+    TEST_CHECK(subscribes == m_subscribes);
+    TEST_CHECK(NULL == is_ext_topic_subscribed(&m_packed[EXT_SUB_LIMIT_PER_ENDPOINT]));
+
+    // the existing group - no member without the list entry
+    TEST_CHECK(0 == model_subscribe(1, EXT_SUB_LIMIT_PER_ENDPOINT));
+    TEST_CHECK(0 == config_subscribe(1, EXT_SUB_LIMIT_PER_ENDPOINT));
+    TEST_CHECK(-11 == config_subscribe(0, EXT_SUB_LIMIT_PER_ENDPOINT));
+    TEST_CHECK(groups_are_consistent());
+
+    // room again
+    TEST_CHECK(0 == model_unsubscribe(0, 0));
+    TEST_CHECK(0 == config_unsubscribe(0, 0));
+    TEST_CHECK(0 == model_subscribe(0, EXT_SUB_LIMIT_PER_ENDPOINT));
+    TEST_CHECK(0 == config_subscribe(0, EXT_SUB_LIMIT_PER_ENDPOINT));
+    TEST_CHECK(groups_are_consistent());
+}
+
+
+/*
+ * The own config/list response topic is recognized until the clean session
+ */
+static void test_list_topic(void)
+{
+    model_reset();
+
+    TEST_CHECK(false == service_config_is_list_topic(0));
+
+    m_list_stream.topic_id = 77;
+
+    TEST_CHECK(service_config_is_list_topic(77));
+    TEST_CHECK(false == service_config_is_list_topic(78));
+
+    service_config_resume(false);
+    TEST_CHECK(service_config_is_list_topic(77));
+
+    service_config_resume(true);
+    TEST_CHECK(false == service_config_is_list_topic(77));
+    TEST_CHECK(false == service_config_is_list_topic(0));
+}
+
+
+/*
+ * The SUBACK of the group which does not fit in the dispatch table - the
+ * group is rolled back and unsubscribed
+ */
+static void test_dispatch_full(void)
+{
+    model_reset();
+
+    uint16_t filler = 0xF000;
+
+    while (0 == service_dispatch_add_self(filler, 0, info))
+        filler++;
+
+    TEST_CHECK(0 == config_subscribe_sent(0, 0));
+
+    service_owner_cb owner_cb = m_owner_cb;
+
+    service_destroy(0);
+    TEST_CHECK(0 != owner_cb(m_next_topic_id++, true));
+
+    TEST_CHECK(0 == m_ext_topics_cnt);
+    TEST_CHECK(NULL == is_ext_topic_subscribed(&m_packed[0]));
+    TEST_CHECK(0 == m_sub_list_arr[0].sub_counter);
+    TEST_CHECK(m_unsub_is_pending);
+
+    acks_flush();
+    service_dispatch_clear(dispatch_self);
+
+    // room again
+    TEST_CHECK(0 == model_subscribe(0, 0));
+    TEST_CHECK(0 == config_subscribe(0, 0));
+    TEST_CHECK(groups_are_consistent());
+}
+
+
+/*
+ * The retry limit of the SUBSCRIBE and UNSUBSCRIBE - nothing stays pending
+ */
+static void test_request_lost(void)
+{
+    model_reset();
+
+    TEST_CHECK(0 == config_subscribe_sent(0, 0));
+
+    service_owner_cb owner_cb = m_owner_cb;
+
+    service_destroy(0);
+    TEST_CHECK(0 != owner_cb(0, false));
+    TEST_CHECK(false == is_ext_sub_pending());
+    TEST_CHECK(NULL == is_ext_topic_subscribed(&m_packed[0]));
+
+    // asked again
+    TEST_CHECK(0 == model_subscribe(0, 0));
+    TEST_CHECK(0 == config_subscribe(0, 0));
+    TEST_CHECK(0 == model_unsubscribe(0, 0));
+    TEST_CHECK(0 == service_config_unsubscribe(0,
+                                               (uint8_t *) m_names[0],
+                                               EXT_ENDPOINT_LENGTH));
+    owner_cb = m_owner_cb;
+
+    service_destroy(0);
+    TEST_CHECK(0 != owner_cb(0, false));
+    TEST_CHECK(false == m_unsub_is_pending);
+    TEST_CHECK(1 == m_unsub_cnt);
+    TEST_CHECK(groups_are_consistent());
+
+    // sent after the reconnection
+    TEST_CHECK(0 == service_config_continue());
+    acks_flush();
+    TEST_CHECK(0 == m_unsub_cnt);
+}
+
+
+/***************************************************************************************************
+ * @section Benchmark
+ **************************************************************************************************/
+
+static double now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+
+// the lookup before the name index
+static ext_sub_topic_t * linear_find(const ext_endpoint_t * p_ext_endpoint)
+{
+    for (uint8_t i = 0; i < m_ext_topics_cnt; i++)
+    {
+        if (0 == memcmp(p_ext_endpoint,
+                        &m_ext_topics[i].ext_endpoint,
+                        sizeof(ext_endpoint_t)))
+            return &m_ext_topics[i];
+    }
+
+    return NULL;
+}
+
+
+/*
+ * The groups are put to the array and the index directly (no members),
+ * every other lookup misses
+ */
+static void bench_groups(uint16_t cnt)
+{
+    volatile uintptr_t sink = 0;
+    ext_endpoint_t     names[2 * EXT_TOPIC_LIMIT];
+
+    model_reset();
+
+    for (uint16_t i = 0; i < 2 * cnt; i++)
+    {
+        for (uint8_t j = 0; j < EXT_ID_SIZE; j++)
+            names[i].id[j] = (uint8_t) test_rand();
+
+        names[i].endpoint = i % (SERVICE_ENDPOINT_MAX + 1);
+    }
+
+    for (uint16_t i = 0; i < cnt; i++)
+    {
+        m_ext_topics[i].ext_endpoint = names[2 * i];
+        m_ext_topics_cnt++;
+        name_index_add((uint8_t) i);
+    }
+
+    double start = now_ns();
+
+    for (uint32_t i = 0; i < BENCH_ROUNDS; i++)
+        sink += (uintptr_t) is_ext_topic_subscribed(&names[i % (2 * cnt)]);
+
+    double indexed = (now_ns() - start) / BENCH_ROUNDS;
+
+    start = now_ns();
+
+    for (uint32_t i = 0; i < BENCH_ROUNDS; i++)
+        sink += (uintptr_t) linear_find(&names[i % (2 * cnt)]);
+
+    double linear = (now_ns() - start) / BENCH_ROUNDS;
+
+    printf("%3d groups: name index %.1f ns, linear %.1f ns\n",
+           cnt, indexed, linear);
+
+    memset(m_ext_topics, 0, sizeof(m_ext_topics));
+    model_reset();
+    (void) sink;
+}
+
+
+static void bench(void)
+{
+    for (uint16_t cnt = 8; cnt < EXT_TOPIC_LIMIT; cnt *= 2)
+        bench_groups(cnt);
+
+    bench_groups(EXT_TOPIC_LIMIT);
+}
+
+
+int main(int argc, char *argv[])
+{
+    if (argc > 1)
+        m_rand_state = (uint32_t) strtoul(argv[1], NULL, 0) | 1;
+
+    names_init();
+
+    test_remove_swap();
+    test_sub_list_full();
+    test_list_topic();
+    test_dispatch_full();
+    test_request_lost();
+    test_random();
+    bench();
+
+    return TEST_RESULT("test_service_config");
+}
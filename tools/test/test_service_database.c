@@ -0,0 +1,378 @@
+/*
+ * test_service_database.c
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: MSc Patryk Silkowski
+ *
+ * Host test of the sorted service database (service_setup.c). The module is
+ * included to reach the database and its invariants. The services are added
+ * and deleted in random order, the benchmark prints the cost of the lookup,
+ * the insertion and the deletion at the full database.
+ *
+ * The database holds at most SERVICE_BSP_ENDPOINTS * type_none services
+ * (one per key), so the benchmark is run at that size - larger sizes do not
+ * exist on the device (the indexes are uint8_t).
+ *
+ * usage: test_service_database [<seed>]
+ */
+
+/* GCC */
+#include <stdlib.h>
+#include <time.h>
+
+/* APP */
+#include "service_setup.c"
+
+/* TEST */
+#include "test.h"
+
+
+#define SERVICE_KEYS            (SERVICE_BSP_ENDPOINTS * type_none)
+#define RANDOM_ROUNDS           500
+#define BENCH_ROUNDS            200000
+#define ID_STEP                 97          // the IDs of the round never wrap to 0
+
+STATIC_ASSERT(SERVICE_KEYS <= SERVICE_DATA_ARRAY_SIZE);
+
+
+static uint32_t m_rand_state = 1;
+
+
+static uint32_t test_rand(void)
+{
+    // xorshift32
+    m_rand_state ^= m_rand_state << 13;
+    m_rand_state ^= m_rand_state >> 17;
+    m_rand_state ^= m_rand_state << 5;
+
+    return m_rand_state;
+}
+
+
+static void keys_shuffle(uint16_t * p_keys)
+{
+    for (uint16_t i = 0; i < SERVICE_KEYS; i++)
+        p_keys[i] = i;
+
+    for (uint16_t i = SERVICE_KEYS - 1; i > 0; i--)
+    {
+        uint16_t j   = test_rand() % (i + 1);
+        uint16_t tmp = p_keys[i];
+
+        p_keys[i] = p_keys[j];
+        p_keys[j] = tmp;
+    }
+}
+
+
+static service_data_t service_of(uint16_t key, uint16_t topic_id)
+{
+    service_data_t service =
+    {
+        .topic_id = topic_id,
+        .type     = key % type_none,
+        .endpoint = key / type_none,
+    };
+
+    return service;
+}
+
+
+/*
+ * Sorted by the key, each service is dispatched with its topic ID
+ */
+static bool database_is_consistent(void)
+{
+    for (uint8_t i = 0; i < m_service_cnt; i++)
+    {
+        service_data_t         * p_service = &m_service_database[i];
+        const dispatch_entry_t * p_entry   = service_dispatch_find(p_service->topic_id);
+
+        if (   i
+            && database_key(m_service_database[i - 1].endpoint,
+                            m_service_database[i - 1].type)
+               >= database_key(p_service->endpoint, p_service->type))
+            return false;
+
+        if (   NULL == p_entry
+            || dispatch_self != p_entry->kind
+            || p_service->endpoint != p_entry->self.endpoint
+            || p_service->type != p_entry->self.type)
+            return false;
+    }
+
+    return true;
+}
+
+
+static void test_bounds(void)
+{
+    service_data_t service = service_of(0, 1);
+
+    TEST_CHECK(-1 == database_add(NULL));
+
+    service.type = type_none;
+    TEST_CHECK(-1 == database_add(&service));
+
+    service = service_of(0, 1);
+    service.endpoint = SERVICE_BSP_ENDPOINTS;
+    TEST_CHECK(-1 == database_add(&service));
+
+    TEST_CHECK(0 == m_service_cnt);
+    TEST_CHECK(-1 == database_delete_with_topic_id(1));
+    TEST_CHECK(-1 == database_delete_with_topic_id(0));
+}
+
+
+static void test_random(void)
+{
+    uint16_t keys[SERVICE_KEYS];
+    uint16_t ids[SERVICE_KEYS];
+
+    for (uint16_t round = 0; round < RANDOM_ROUNDS; round++)
+    {
+        uint16_t base   = 1 + test_rand() % (UINT16_MAX - (SERVICE_KEYS + 1) * ID_STEP);
+        uint16_t ext_id = base + SERVICE_KEYS * ID_STEP;
+
+        keys_shuffle(keys);
+
+        for (uint16_t i = 0; i < SERVICE_KEYS; i++)
+        {
+            // unique IDs in the random order
+            ids[keys[i]] = base + i * ID_STEP;
+
+            service_data_t service = service_of(keys[i], ids[keys[i]]);
+
+            TEST_CHECK(0 == database_add(&service));
+        }
+
+        TEST_CHECK(SERVICE_KEYS == m_service_cnt);
+        TEST_CHECK(database_is_consistent());
+
+        // the new session - the same service gets the other ID
+        uint16_t       key     = keys[0];
+        service_data_t service = service_of(key, (uint16_t) (ids[key] + 1));
+
+        TEST_CHECK(0 == database_add(&service));
+        TEST_CHECK(SERVICE_KEYS == m_service_cnt);
+        TEST_CHECK(NULL == service_dispatch_find(ids[key]));
+        ids[key] = service.topic_id;
+
+        // the ID taken over by another service drops the stale one
+        uint16_t victim = keys[1];
+
+        service = service_of(keys[2], ids[victim]);
+        TEST_CHECK(0 == database_add(&service));
+        TEST_CHECK(SERVICE_KEYS - 1 == m_service_cnt);
+        TEST_CHECK(NULL == database_find(victim / type_none, victim % type_none));
+        TEST_CHECK(NULL == service_dispatch_find(ids[keys[2]]));
+        TEST_CHECK(database_is_consistent());
+        ids[keys[2]] = ids[victim];
+        ids[victim]  = 0;
+
+        // the ext topic IDs are not deleted from the database
+        TEST_CHECK(0 == service_dispatch_add_ext(ext_id, 0));
+        TEST_CHECK(-1 == database_delete_with_topic_id(ext_id));
+        TEST_CHECK(NULL != service_dispatch_find(ext_id));
+        service_dispatch_clear(dispatch_ext);
+
+        keys_shuffle(keys);
+
+        for (uint16_t i = 0; i < SERVICE_KEYS; i++)
+        {
+            uint16_t topic_id = ids[keys[i]];
+
+            if (0 == topic_id)
+                continue;
+
+            TEST_CHECK(0 == database_delete_with_topic_id(topic_id));
+            TEST_CHECK(-1 == database_delete_with_topic_id(topic_id));
+            TEST_CHECK(NULL == database_find(keys[i] / type_none, keys[i] % type_none));
+
+            if (0 == i % 8)
+                TEST_CHECK(database_is_consistent());
+        }
+
+        TEST_CHECK(0 == m_service_cnt);
+        TEST_CHECK(NULL == service_dispatch_find(ids[keys[0]]));
+    }
+}
+
+
+/*
+ * The gateway REGISTER carries the topic name without the terminator - the
+ * bytes past the name must not change the result
+ */
+static int8_t learn(uint16_t topic_id, const char * p_name, uint16_t length)
+{
+    char buffer[MQTTSN_TOPIC_NAME_LENGTH + 8];
+
+    memset(buffer, 'x', sizeof(buffer));
+    memcpy(buffer, p_name, strlen(p_name));
+
+    return service_learn_topic(topic_id, buffer, length);
+}
+
+
+static void test_learn_topic(void)
+{
+    char name[MQTTSN_TOPIC_NAME_LENGTH + 1];
+
+    database_clear();
+
+    snprintf(name, sizeof(name), "%s/3/" SERVICE_STR_CONFIG_SUB, comm_utils_get_id());
+
+    TEST_CHECK(0 == learn(11, name, strlen(name)));
+    TEST_CHECK(NULL != database_find(3, config_sub));
+    TEST_CHECK(11 == database_find(3, config_sub)->topic_id);
+
+    // the prefix of the other type, the type followed by the bytes
+    TEST_CHECK(-4 == learn(12, name, strlen(name) - 1));
+    TEST_CHECK(-4 == learn(12, name, strlen(name) + 1));
+    TEST_CHECK(-2 == learn(12, name, BASE64_LENGTH + 3));
+    TEST_CHECK(-2 == learn(12, name, 0));
+    TEST_CHECK(-1 == service_learn_topic(12, NULL, strlen(name)));
+
+    snprintf(name, sizeof(name), "%s/3/" SERVICE_STR_CONFIG_UNSUB, comm_utils_get_id());
+    TEST_CHECK(0 == learn(13, name, strlen(name)));
+    TEST_CHECK(13 == database_find(3, config_unsub)->topic_id);
+
+    snprintf(name, sizeof(name), "%s/%d/" SERVICE_STR_ONOFF,
+             comm_utils_get_id(), SERVICE_BSP_ENDPOINTS);
+    TEST_CHECK(-3 == learn(14, name, strlen(name)));
+
+    TEST_CHECK(2 == m_service_cnt);
+    TEST_CHECK(database_is_consistent());
+
+    database_clear();
+}
+
+
+static unsigned m_owner_calls;
+static bool     m_owner_acked;
+
+
+static int8_t owner(uint16_t topic_id, bool is_acked)
+{
+    m_owner_calls++;
+    m_owner_acked = is_acked;
+    return 0;
+}
+
+
+/*
+ * The SUBACK which never comes - the slot is released at the retry limit
+ * and the owner learns the request is lost
+ */
+static void test_retry_limit(void)
+{
+    int8_t slot = service_create(comm_utils_get_id(), 2, onoff);
+
+    TEST_CHECK(slot >= 0);
+    if (slot < 0)
+        return;
+
+    service_subscribe((uint8_t) slot, owner);     // the stub sends nothing
+
+    mqttsn_event_t timeout =
+    {
+        .event_id = MQTTSN_EVENT_TIMEOUT,
+        .event_data.error =
+        {
+            .error    = MQTTSN_ERROR_TIMEOUT,
+            .msg_type = MQTTSN_PACKET_SUBACK,
+            .msg_id   = m_srv_setup[slot].message_id,
+        },
+    };
+
+    for (uint8_t i = 1; i < DEFAULT_RETRANSMISSION_CNT; i++)
+    {
+        TEST_CHECK(0 == slot_ack_handler(&timeout, &m_srv_setup[slot]));
+        TEST_CHECK(m_srv_setup[slot].is_created);
+    }
+
+    TEST_CHECK(0 == m_owner_calls);
+    TEST_CHECK(SERVICE_RETRY_CNT_MAX_FLAG == slot_ack_handler(&timeout,
+                                                              &m_srv_setup[slot]));
+    TEST_CHECK(false == m_srv_setup[slot].is_created);
+    TEST_CHECK(1 == m_owner_calls);
+    TEST_CHECK(false == m_owner_acked);
+
+    // the late timeout of the released slot
+    TEST_CHECK(-2 == slot_ack_handler(&timeout, &m_srv_setup[slot]));
+    TEST_CHECK(1 == m_owner_calls);
+}
+
+
+static double now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+
+static void bench(void)
+{
+    uint16_t          keys[SERVICE_KEYS];
+    volatile uint32_t sink = 0;
+
+    database_clear();
+    keys_shuffle(keys);
+
+    for (uint16_t i = 0; i < SERVICE_KEYS; i++)
+    {
+        service_data_t service = service_of(keys[i], 100 + keys[i]);
+
+        database_add(&service);
+    }
+
+    double start = now_ns();
+
+    for (uint32_t i = 0; i < BENCH_ROUNDS; i++)
+    {
+        uint16_t key = keys[i % SERVICE_KEYS];
+
+        sink += database_find(key / type_none, key % type_none)->topic_id;
+    }
+
+    double find = (now_ns() - start) / BENCH_ROUNDS;
+
+    start = now_ns();
+
+    // delete and add back - the memmove of the tail included
+    for (uint32_t i = 0; i < BENCH_ROUNDS; i++)
+    {
+        uint16_t       key     = keys[i % SERVICE_KEYS];
+        service_data_t service = service_of(key, 100 + key);
+
+        database_delete_with_topic_id(service.topic_id);
+        database_add(&service);
+    }
+
+    double update = (now_ns() - start) / BENCH_ROUNDS;
+
+    printf("%d services: find %.1f ns, delete + add %.1f ns\n",
+           m_service_cnt, find, update);
+
+    database_clear();
+    (void) sink;
+}
+
+
+int main(int argc, char *argv[])
+{
+    if (argc > 1)
+        m_rand_state = (uint32_t) strtoul(argv[1], NULL, 0) | 1;
+
+    comm_utils_id_gen();
+
+    test_bounds();
+    test_learn_topic();
+    test_retry_limit();
+    test_random();
+    bench();
+
+    return TEST_RESULT("test_service_database");
+}
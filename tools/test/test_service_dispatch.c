@@ -0,0 +1,464 @@
+/*
+ * test_service_dispatch.c
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: MSc Patryk Silkowski
+ *
+ * Host test of the topic ID dispatch table (service_dispatch.c). The module
+ * is included, so the test builds the colliding IDs with its hash and checks
+ * the probing invariant of the table after each operation. The randomized
+ * part assigns the IDs in any order (as the gateway might) and compares
+ * the table with the reference model. The benchmark prints the cost of
+ * the lookup at the growing load.
+ *
+ * usage: test_service_dispatch [<seed>]
+ */
+
+/* GCC */
+#include <stdlib.h>
+#include <time.h>
+
+/* APP */
+#include "service_dispatch.c"
+
+/* TEST */
+#include "test.h"
+
+
+#define RANDOM_ROUNDS           200
+#define RANDOM_OPS              2000
+#define BENCH_LOOKUPS           1000000
+
+
+typedef struct {
+    bool            is_used;
+    dispatch_kind_t kind;
+    uint8_t         value;      // endpoint or ext index
+} model_entry_t;
+
+static model_entry_t m_model[UINT16_MAX + 1];
+static uint16_t      m_model_ids[SERVICE_DISPATCH_TABLE_SIZE];
+static uint8_t       m_model_cnt;
+
+static uint32_t      m_rand_state = 1;
+
+
+static uint32_t test_rand(void)
+{
+    // xorshift32
+    m_rand_state ^= m_rand_state << 13;
+    m_rand_state ^= m_rand_state >> 17;
+    m_rand_state ^= m_rand_state << 5;
+
+    return m_rand_state;
+}
+
+
+/*
+ * Each entry has to be reachable from its home without crossing an empty one
+ */
+static bool table_is_consistent(void)
+{
+    uint8_t cnt = 0;
+
+    for (uint16_t i = 0; i < SERVICE_DISPATCH_TABLE_SIZE; i++)
+    {
+        if (0 == m_table[i].topic_id)
+            continue;
+
+        cnt++;
+
+        for (uint16_t idx = dispatch_hash(m_table[i].topic_id);
+             idx != i;
+             idx = (idx + 1) & DISPATCH_MASK)
+        {
+            if (0 == m_table[idx].topic_id)
+                return false;
+        }
+    }
+
+    return cnt == m_entry_cnt;
+}
+
+
+/*
+ * Topic IDs which share the home entry, starting from first_id
+ */
+static uint8_t colliding_ids_get(uint16_t home, uint16_t first_id,
+                                 uint16_t * p_ids, uint8_t cnt)
+{
+    uint8_t found = 0;
+
+    for (uint32_t id = first_id; id <= UINT16_MAX && found < cnt; id++)
+    {
+        if (home == dispatch_hash((uint16_t) id))
+            p_ids[found++] = (uint16_t) id;
+    }
+
+    return found;
+}
+
+
+static void test_basic(void)
+{
+    TEST_CHECK(NULL == service_dispatch_find(0));
+    TEST_CHECK(NULL == service_dispatch_find(1));
+    TEST_CHECK(-1 == service_dispatch_add_self(0, 0, onoff));
+
+    TEST_CHECK(0 == service_dispatch_add_self(1, 3, onoff));
+    TEST_CHECK(0 == service_dispatch_add_ext(0xFFFF, 7));
+
+    const dispatch_entry_t * p_entry = service_dispatch_find(1);
+
+    TEST_CHECK(NULL != p_entry);
+    TEST_CHECK(p_entry && dispatch_self == p_entry->kind);
+    TEST_CHECK(p_entry && 3 == p_entry->self.endpoint);
+    TEST_CHECK(p_entry && onoff == p_entry->self.type);
+
+    p_entry = service_dispatch_find(0xFFFF);
+    TEST_CHECK(p_entry && dispatch_ext == p_entry->kind);
+    TEST_CHECK(p_entry && 7 == p_entry->ext_index);
+
+    // the topic ID reused by the other kind (new session)
+    TEST_CHECK(0 == service_dispatch_add_ext(1, 2));
+    p_entry = service_dispatch_find(1);
+    TEST_CHECK(p_entry && dispatch_ext == p_entry->kind);
+    TEST_CHECK(2 == m_entry_cnt);
+
+    service_dispatch_clear(dispatch_ext);
+    TEST_CHECK(NULL == service_dispatch_find(1));
+    TEST_CHECK(NULL == service_dispatch_find(0xFFFF));
+    TEST_CHECK(0 == m_entry_cnt);
+}
+
+
+static void test_collisions(void)
+{
+    uint16_t ids[6];
+    uint16_t home = SERVICE_DISPATCH_TABLE_SIZE - 2;    // the cluster wraps
+
+    TEST_CHECK(6 == colliding_ids_get(home, 1, ids, 6));
+
+    for (uint8_t i = 0; i < 6; i++)
+    {
+        TEST_CHECK(0 == service_dispatch_add_self(ids[i], i, info));
+    }
+
+    TEST_CHECK(table_is_consistent());
+
+    // the entry probing from the next home sits behind the cluster
+    uint16_t next_home_id = 0;
+
+    TEST_CHECK(1 == colliding_ids_get((home + 1) & DISPATCH_MASK, 1, &next_home_id, 1));
+    TEST_CHECK(0 == service_dispatch_add_ext(next_home_id, 9));
+
+    // remove from the head, the middle and the tail of the cluster
+    uint8_t order[6] = { 0, 3, 5, 1, 4, 2 };
+
+    for (uint8_t i = 0; i < 6; i++)
+    {
+        service_dispatch_remove(ids[order[i]]);
+
+        TEST_CHECK(table_is_consistent());
+        TEST_CHECK(NULL == service_dispatch_find(ids[order[i]]));
+
+        for (uint8_t j = i + 1; j < 6; j++)
+        {
+            const dispatch_entry_t * p_entry = service_dispatch_find(ids[order[j]]);
+
+            TEST_CHECK(p_entry && order[j] == p_entry->self.endpoint);
+        }
+
+        const dispatch_entry_t * p_next = service_dispatch_find(next_home_id);
+
+        TEST_CHECK(p_next && 9 == p_next->ext_index);
+    }
+
+    // removal of the unknown ID changes nothing
+    service_dispatch_remove(ids[0]);
+    TEST_CHECK(1 == m_entry_cnt);
+
+    service_dispatch_remove(next_home_id);
+    TEST_CHECK(0 == m_entry_cnt);
+    TEST_CHECK(table_is_consistent());
+}
+
+
+static void test_full_table(void)
+{
+    uint16_t id;
+
+    for (id = 1; id < SERVICE_DISPATCH_TABLE_SIZE; id++)
+    {
+        TEST_CHECK(0 == service_dispatch_add_ext(id, (uint8_t) id));
+    }
+
+    // one entry stays empty to terminate the probing of a miss
+    TEST_CHECK(-1 == service_dispatch_add_ext(id, 0));
+    TEST_CHECK(NULL == service_dispatch_find(id));
+
+    // the existing entry is still updated
+    TEST_CHECK(0 == service_dispatch_add_ext(1, 200));
+    TEST_CHECK(200 == service_dispatch_find(1)->ext_index);
+
+    service_dispatch_clear(dispatch_ext);
+    TEST_CHECK(0 == m_entry_cnt);
+}
+
+
+static void model_remove(uint8_t idx)
+{
+    m_model[m_model_ids[idx]].is_used = false;
+    m_model_ids[idx] = m_model_ids[--m_model_cnt];
+}
+
+
+static bool table_matches_model(void)
+{
+    for (uint8_t i = 0; i < m_model_cnt; i++)
+    {
+        const model_entry_t    * p_model = &m_model[m_model_ids[i]];
+        const dispatch_entry_t * p_entry = service_dispatch_find(m_model_ids[i]);
+
+        if (   NULL == p_entry
+            || p_model->kind != p_entry->kind)
+            return false;
+
+        uint8_t value = (dispatch_self == p_entry->kind) ? p_entry->self.endpoint
+                                                         : p_entry->ext_index;
+        if (value != p_model->value)
+            return false;
+    }
+
+    return m_model_cnt == m_entry_cnt;
+}
+
+
+static void test_random(void)
+{
+    for (uint16_t round = 0; round < RANDOM_ROUNDS; round++)
+    {
+        // sequential IDs from the random start, shared topics far away
+        uint16_t base = (uint16_t) test_rand();
+
+        for (uint16_t op = 0; op < RANDOM_OPS; op++)
+        {
+            uint32_t r  = test_rand();
+            uint16_t id = (r & 1) ? (uint16_t) (base + (r >> 8) % 64)
+                                  : (uint16_t) (r >> 16);
+            if (0 == id)
+                continue;
+
+            if (   m_model[id].is_used
+                && (r & 0x80))
+            {
+                for (uint8_t i = 0; i < m_model_cnt; i++)
+                {
+                    if (m_model_ids[i] == id)
+                    {
+                        model_remove(i);
+                        break;
+                    }
+                }
+
+                service_dispatch_remove(id);
+            }
+            else
+            {
+                dispatch_kind_t kind  = (r & 0x40) ? dispatch_ext : dispatch_self;
+                uint8_t         value = (uint8_t) (r >> 24) % SERVICE_BSP_ENDPOINTS;
+                int8_t          ret   = (dispatch_ext == kind)
+                        ? service_dispatch_add_ext(id, value)
+                        : service_dispatch_add_self(id, value, info);
+
+                if (   false == m_model[id].is_used
+                    && m_model_cnt >= SERVICE_DISPATCH_TABLE_SIZE - 1)
+                {
+                    TEST_CHECK(-1 == ret);
+                    continue;
+                }
+
+                TEST_CHECK(0 == ret);
+
+                if (false == m_model[id].is_used)
+                    m_model_ids[m_model_cnt++] = id;
+
+                m_model[id].is_used = true;
+                m_model[id].kind    = kind;
+                m_model[id].value   = value;
+            }
+
+            if (0 == op % 64)
+            {
+                TEST_CHECK(table_is_consistent());
+                TEST_CHECK(table_matches_model());
+            }
+        }
+
+        TEST_CHECK(table_is_consistent());
+        TEST_CHECK(table_matches_model());
+
+        // the misses stop on the empty entry
+        for (uint8_t i = 0; i < 32; i++)
+        {
+            uint16_t id = (uint16_t) test_rand();
+
+            if (id && false == m_model[id].is_used)
+                TEST_CHECK(NULL == service_dispatch_find(id));
+        }
+
+        // the clear of one kind keeps the other one in place
+        dispatch_kind_t cleared = (round & 1) ? dispatch_ext : dispatch_self;
+
+        service_dispatch_clear(cleared);
+
+        for (uint8_t i = 0; i < m_model_cnt; )
+        {
+            if (cleared == m_model[m_model_ids[i]].kind)
+            {
+                TEST_CHECK(NULL == service_dispatch_find(m_model_ids[i]));
+                model_remove(i);
+            }
+            else
+                i++;
+        }
+
+        TEST_CHECK(table_is_consistent());
+        TEST_CHECK(table_matches_model());
+
+        while (m_model_cnt)
+        {
+            uint8_t idx = (uint8_t) (test_rand() % m_model_cnt);
+
+            service_dispatch_remove(m_model_ids[idx]);
+            model_remove(idx);
+        }
+
+        TEST_CHECK(0 == m_entry_cnt);
+        TEST_CHECK(table_is_consistent());
+    }
+}
+
+
+static double now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+
+static void bench(void)
+{
+    static const uint8_t loads[] = { 16, 32, 64, 96, 120 };
+    uint16_t             ids[SERVICE_DISPATCH_TABLE_SIZE];
+    volatile uint32_t    sink = 0;
+
+    printf("%8s %12s %12s\n", "entries", "hit [ns]", "miss [ns]");
+
+    for (uint8_t l = 0; l < sizeof(loads); l++)
+    {
+        uint16_t base = (uint16_t) test_rand();
+        uint8_t  cnt  = 0;
+
+        service_dispatch_clear(dispatch_self);
+        service_dispatch_clear(dispatch_ext);
+
+        // the gateway assigns the IDs sequentially
+        for (uint16_t id = base; cnt < loads[l]; id++)
+        {
+            if (0 == id)
+                continue;
+
+            service_dispatch_add_ext(id, cnt);
+            ids[cnt++] = id;
+        }
+
+        double start = now_ns();
+
+        for (uint32_t i = 0; i < BENCH_LOOKUPS; i++)
+            sink += service_dispatch_find(ids[i % cnt])->ext_index;
+
+        double hit = (now_ns() - start) / BENCH_LOOKUPS;
+
+        start = now_ns();
+
+        for (uint32_t i = 0; i < BENCH_LOOKUPS; i++)
+            sink += (NULL != service_dispatch_find((uint16_t) (base - 1 - i % 1024)));
+
+        double miss = (now_ns() - start) / BENCH_LOOKUPS;
+
+        printf("%8d %12.1f %12.1f\n", cnt, hit, miss);
+    }
+
+    service_dispatch_clear(dispatch_ext);
+    (void) sink;
+}
+
+
+/*
+ * The predefined self IDs next to the normal IDs the gateway hands out from 1
+ * (the SUBACKs of the groups, the REGISTERs after the '<id>/#' SUBSCRIBE)
+ */
+static void test_predefined(void)
+{
+    uint16_t normal_cnt = SERVICE_DISPATCH_TABLE_SIZE - 1 - SERVICE_SELF_TOPIC_ID_MAX;
+
+    for (endpoint_t endpoint = 0; endpoint < SERVICE_BSP_ENDPOINTS; endpoint++)
+    {
+        for (service_type_t type = info; type < type_none; type++)
+        {
+            uint16_t topic_id = SERVICE_PREDEFINED_TOPIC_ID(endpoint, type);
+
+            TEST_CHECK(topic_id > SERVICE_NORMAL_TOPIC_ID_MAX);
+            TEST_CHECK(0 == service_dispatch_add_self(topic_id, endpoint, type));
+        }
+    }
+
+    for (uint16_t topic_id = 1; topic_id <= normal_cnt; topic_id++)
+        TEST_CHECK(0 == service_dispatch_add_ext(topic_id, (uint8_t) topic_id));
+
+    for (endpoint_t endpoint = 0; endpoint < SERVICE_BSP_ENDPOINTS; endpoint++)
+    {
+        for (service_type_t type = info; type < type_none; type++)
+        {
+            const dispatch_entry_t * p_entry = service_dispatch_find(
+                                SERVICE_PREDEFINED_TOPIC_ID(endpoint, type));
+
+            TEST_CHECK(p_entry && dispatch_self == p_entry->kind);
+            TEST_CHECK(p_entry && endpoint == p_entry->self.endpoint);
+            TEST_CHECK(p_entry && type == p_entry->self.type);
+        }
+    }
+
+    for (uint16_t topic_id = 1; topic_id <= normal_cnt; topic_id++)
+    {
+        const dispatch_entry_t * p_entry = service_dispatch_find(topic_id);
+
+        TEST_CHECK(p_entry && dispatch_ext == p_entry->kind);
+        TEST_CHECK(p_entry && (uint8_t) topic_id == p_entry->ext_index);
+    }
+
+    TEST_CHECK(table_is_consistent());
+
+    service_dispatch_clear(dispatch_ext);
+    service_dispatch_clear(dispatch_self);
+    TEST_CHECK(0 == m_entry_cnt);
+}
+
+
+int main(int argc, char *argv[])
+{
+    if (argc > 1)
+        m_rand_state = (uint32_t) strtoul(argv[1], NULL, 0) | 1;
+
+    test_basic();
+    test_collisions();
+    test_full_table();
+    test_predefined();
+    test_random();
+    bench();
+
+    return TEST_RESULT("test_service_dispatch");
+}
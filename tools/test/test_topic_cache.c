@@ -0,0 +1,156 @@
+/*
+ * test_topic_cache.c
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: MSc Patryk Silkowski
+ *
+ * Host test of the topic ID cache (service_setup.c) on top of mash_storage.c
+ * and the mock flash. Checks the restore after reboot, the invalidation and
+ * that the page is erased only when the record changes (the services are
+ * ready on every resume and every wake of the sleepy node).
+ *
+ * usage: test_topic_cache
+ */
+
+/* GCC */
+#include <stdio.h>
+#include <string.h>
+
+/* APP */
+#include "comm_utils.h"
+#include "mash_storage.h"
+#include "service_setup.h"
+
+/* TEST */
+#include "mock_flash.h"
+#include "stub_comm.h"
+#include "test.h"
+
+
+#define GATEWAY_ID              1
+#define CACHE_PAGE_ADDR         0xF8000     // storage_topic_cache
+#define CACHE_HEADER_SIZE       8
+#define WAKES_PER_DAY           1500
+
+
+static const char * const m_type_str[type_none] = SERVICE_TYPE_STRINGS;
+
+
+static uint16_t topic_id_of(endpoint_t endpoint, service_type_t type)
+{
+    return 100 + endpoint * type_none + type;
+}
+
+
+static void learn_all(uint16_t id_offset)
+{
+    char topic_name[64];
+
+    for (endpoint_t endpoint = 0; endpoint < SERVICE_BSP_ENDPOINTS; endpoint++)
+    {
+        for (service_type_t type = info; type < type_none; type++)
+        {
+            snprintf(topic_name, sizeof(topic_name), "%s/%d/%s",
+                     comm_utils_get_id(), endpoint, m_type_str[type]);
+
+            TEST_CHECK(0 == service_learn_topic(topic_id_of(endpoint, type)
+                                                + id_offset,
+                                                topic_name,
+                                                strlen(topic_name)));
+        }
+    }
+}
+
+
+static bool database_matches(uint16_t id_offset)
+{
+    for (endpoint_t endpoint = 0; endpoint < SERVICE_BSP_ENDPOINTS; endpoint++)
+    {
+        for (service_type_t type = info; type < type_none; type++)
+        {
+            uint16_t topic_id = 0;
+
+            if (   service_topic_id_get(endpoint, type, &topic_id)
+                || topic_id != topic_id_of(endpoint, type) + id_offset)
+                return false;
+        }
+    }
+
+    return true;
+}
+
+
+static void test_store_and_restore(void)
+{
+    learn_all(0);
+
+    TEST_CHECK(false == service_cache_is_valid(GATEWAY_ID));
+    TEST_CHECK(0 == service_cache_store(GATEWAY_ID));
+    TEST_CHECK(1 == mock_flash_erase_cnt());
+    TEST_CHECK(service_cache_is_valid(GATEWAY_ID));
+    TEST_CHECK(false == service_cache_is_valid(GATEWAY_ID + 1));
+
+    // the session of the other gateway - the database is taken from the flash
+    TEST_CHECK(SERVICE_ALL_REGISTERED_FLAG == create_self_services_resume(GATEWAY_ID));
+    TEST_CHECK(database_matches(0));
+    TEST_CHECK(0 == stub_requests_sent());
+}
+
+
+static void test_unchanged_record_not_written(void)
+{
+    uint32_t erase_cnt = mock_flash_erase_cnt();
+
+    // a day of wakes of the sleepy node, each one ends with the store
+    for (unsigned i = 0; i < WAKES_PER_DAY; i++)
+    {
+        TEST_CHECK(SERVICE_ALL_REGISTERED_FLAG == create_self_services_resume(GATEWAY_ID));
+        TEST_CHECK(0 == service_cache_store(GATEWAY_ID));
+    }
+
+    TEST_CHECK(erase_cnt == mock_flash_erase_cnt());
+}
+
+
+static void test_changed_record_written(void)
+{
+    uint32_t erase_cnt = mock_flash_erase_cnt();
+
+    // new topic IDs from the gateway
+    learn_all(1000);
+    TEST_CHECK(0 == service_cache_store(GATEWAY_ID));
+    TEST_CHECK(++erase_cnt == mock_flash_erase_cnt());
+    TEST_CHECK(0 == service_cache_store(GATEWAY_ID));
+    TEST_CHECK(erase_cnt == mock_flash_erase_cnt());
+
+    // the same topics, but the other gateway
+    TEST_CHECK(0 == service_cache_store(GATEWAY_ID + 1));
+    TEST_CHECK(++erase_cnt == mock_flash_erase_cnt());
+    TEST_CHECK(false == service_cache_is_valid(GATEWAY_ID));
+    TEST_CHECK(service_cache_is_valid(GATEWAY_ID + 1));
+
+    // the corrupted page is never taken for the stored record
+    mock_flash_corrupt(CACHE_PAGE_ADDR + CACHE_HEADER_SIZE + 5, 0x01);
+    TEST_CHECK(false == service_cache_is_valid(GATEWAY_ID + 1));
+    TEST_CHECK(0 == service_cache_store(GATEWAY_ID + 1));
+    TEST_CHECK(++erase_cnt == mock_flash_erase_cnt());
+    TEST_CHECK(service_cache_is_valid(GATEWAY_ID + 1));
+
+    TEST_CHECK(SERVICE_ALL_REGISTERED_FLAG == create_self_services_resume(GATEWAY_ID + 1));
+    TEST_CHECK(database_matches(1000));
+}
+
+
+int main(void)
+{
+    mock_flash_reset();
+    comm_utils_id_gen();
+
+    TEST_CHECK(MASH_STORAGE_SUCCESS == mash_storage_init());
+
+    test_store_and_restore();
+    test_unchanged_record_not_written();
+    test_changed_record_written();
+
+    return TEST_RESULT("test_topic_cache");
+}